@@ -0,0 +1,74 @@
+//
+// Counts heap allocations per event in the monitor event loop, comparing the old
+// by-value EventStruct copy against binding the decoder's event by reference, and
+// the nested vector layout against the flat one.
+//
+
+#include "synthetic_readout.h"
+#include "alloc_counter.h"
+#include "charge_algs.h"
+#include "light_algs.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+template <typename Loop>
+void Measure(const char *name, size_t num_events, Loop &&loop) {
+    // One warm-up pass so the algorithm buffers reach their steady state size
+    loop();
+    size_t start_allocs = data_monitor::NumAllocations();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_events; i++) loop();
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t allocs = data_monitor::NumAllocations() - start_allocs;
+    std::cout << name << ": " << static_cast<double>(allocs) / num_events << " allocs/event, "
+              << num_events / elapsed << " events/s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t num_events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+    // A decoded event shaped like the readout, 3 frames per charge channel and 40 light ROIs
+    synthetic::ReadoutConfig config;
+    std::mt19937 gen(config.seed);
+    EventStruct decoded;
+    synthetic::MakeEvent(config, gen, decoded);
+
+    ChargeAlgs charge_algs;
+    LightAlgs light_algs;
+
+    Measure("minimal, by value", num_events, [&]() {
+        EventStruct evt_data = decoded;
+        charge_algs.MinimalSummary(evt_data);
+        light_algs.MinimalSummary(evt_data);
+    });
+    Measure("minimal, by reference", num_events, [&]() {
+        const EventStruct &evt_data = decoded;
+        charge_algs.MinimalSummary(evt_data);
+        light_algs.MinimalSummary(evt_data);
+    });
+    FlatEvent flat_event;
+    Measure("minimal, flat (fill + summary)", num_events, [&]() {
+        flat_event.Fill(decoded);
+        charge_algs.MinimalSummary(flat_event);
+        light_algs.MinimalSummary(flat_event);
+    });
+    Measure("minimal, flat (summary only)", num_events, [&]() {
+        charge_algs.MinimalSummary(flat_event);
+        light_algs.MinimalSummary(flat_event);
+    });
+    Measure("event, by value", num_events, [&]() {
+        EventStruct evt_data = decoded;
+        charge_algs.GetChargeEvent(evt_data);
+        light_algs.GetLightEvent(evt_data);
+        light_algs.Clear();
+    });
+    Measure("event, by reference", num_events, [&]() {
+        const EventStruct &evt_data = decoded;
+        charge_algs.GetChargeEvent(evt_data);
+        light_algs.GetLightEvent(evt_data);
+        light_algs.Clear();
+    });
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+//
+// Compression ratio and encode throughput of the waveform codec on recorded readout files.
+//
+
+#include "process_events.h"
+#include "flat_event.h"
+#include "waveform_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <pGRAMS_bin_*.dat> [NUM_EVT]\n";
+        return 1;
+    }
+    size_t max_events = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+    ProcessEvents process_events(16, false, std::vector<uint16_t>(), false);
+    if (!process_events.OpenFile(argv[1])) {
+        std::cerr << "Failed to load file!" << std::endl;
+        return 1;
+    }
+
+    FlatEvent event;
+    std::vector<uint32_t> encoded;
+    std::vector<uint16_t> decoded;
+    size_t num_events = 0, raw_words = 0, encoded_words = 0, mismatches = 0;
+    double encode_s = 0;
+    while (num_events < max_events && process_events.GetEvent()) {
+        event.Fill(process_events.GetEventStruct());
+        auto encode_waveform = [&](SampleSpan samples) {
+            encoded.clear();
+            auto start = std::chrono::steady_clock::now();
+            waveform_codec::Encode(samples, samples.empty() ? 0 : samples[0], encoded);
+            encode_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            // The event metrics send one uint32_t per sample
+            raw_words += samples.size();
+            encoded_words += encoded.size();
+            waveform_codec::Decode(encoded, decoded);
+            if (decoded.size() != samples.size() || !std::equal(decoded.begin(), decoded.end(), samples.begin())) mismatches++;
+        };
+        for (size_t i = 0; i < event.NumChargeChannels(); i++) encode_waveform(event.ChargeSamples(i));
+        for (size_t i = 0; i < event.NumLightRois(); i++) encode_waveform(event.LightSamples(i));
+        num_events++;
+    }
+
+    double raw_mb = raw_words * sizeof(uint32_t) / 1e6;
+    std::cout << "Events: " << num_events << "\n"
+              << "Raw payload: " << raw_mb << " MB, encoded: " << encoded_words * sizeof(uint32_t) / 1e6 << " MB\n"
+              << "Compression ratio: " << (encoded_words > 0 ? static_cast<double>(raw_words) / encoded_words : 0) << "\n"
+              << "Encode throughput: " << (encode_s > 0 ? raw_words * sizeof(uint16_t) / 1e6 / encode_s : 0) << " MB/s of samples\n"
+              << "Round trip mismatches: " << mismatches << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+//
+// Writes a synthetic readout .dat file for the benchmarks, see synthetic_readout.h for the layout.
+//
+
+#include "synthetic_readout.h"
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <out.dat> [NUM_EVT] [CHARGE_CH] [CHARGE_SAMPLES] [LIGHT_ROIS]"
+                  << " [NOISE_RMS] [PULSES_PER_CH] [SEED]\n";
+        return 1;
+    }
+    synthetic::ReadoutConfig config;
+    if (argc > 2) config.num_events = std::strtoul(argv[2], nullptr, 10);
+    if (argc > 3) config.num_charge_channels = std::min<size_t>(std::strtoul(argv[3], nullptr, 10), NUM_CHARGE_CHANNELS);
+    if (argc > 4) config.charge_samples = std::strtoul(argv[4], nullptr, 10);
+    if (argc > 5) config.num_light_rois = std::strtoul(argv[5], nullptr, 10);
+    if (argc > 6) config.noise_rms = std::strtod(argv[6], nullptr);
+    if (argc > 7) config.charge_pulse_rate = config.light_pulse_rate = std::strtod(argv[7], nullptr);
+    if (argc > 8) config.seed = static_cast<uint32_t>(std::strtoul(argv[8], nullptr, 10));
+
+    size_t bytes = synthetic::WriteFile(argv[1], config);
+    if (bytes == 0) return 1;
+    std::cout << "Wrote " << config.num_events << " events, " << bytes / 1e6 << " MB to " << argv[1] << std::endl;
+    return 0;
+}
@@ -0,0 +1,165 @@
+//
+// Sequential file scan throughput of the buffered read the decoder does against mmap, the
+// readahead reader and a buffered read with the prefetcher ahead of it, cold and warm cache.
+//
+
+#include "synthetic_readout.h"
+#include "readahead_reader.h"
+#include "file_prefetcher.h"
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace data_monitor;
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    // The decoder's ifstream reads are about this size
+    constexpr size_t BUFFERED_READ_BYTES = 64 * 1024;
+
+    // Stand-in for decoding, a pass over the words plus an optional spin per KiB read
+    struct Consumer {
+        uint64_t spin_ns_per_kb = 0;
+        uint64_t checksum = 0;
+
+        void Consume(const uint8_t *data, size_t size) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+                uint64_t word;
+                std::memcpy(&word, data + i, sizeof(word));
+                sum += word;
+            }
+            checksum += sum;
+            if (spin_ns_per_kb == 0) return;
+            const auto until = Clock::now() + std::chrono::nanoseconds(spin_ns_per_kb * size / 1024);
+            while (Clock::now() < until) {}
+        }
+    };
+
+    // Write back and drop the file's pages, the next read comes from the disk
+    bool DropCache(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        fdatasync(fd);
+        bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        close(fd);
+        return dropped;
+    }
+
+    size_t BufferedScan(const std::string &path, Consumer &consumer, FilePrefetcher *prefetcher) {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<char> buffer(BUFFERED_READ_BYTES);
+        size_t total = 0;
+        while (file.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || file.gcount() > 0) {
+            const auto size = static_cast<size_t>(file.gcount());
+            consumer.Consume(reinterpret_cast<const uint8_t*>(buffer.data()), size);
+            total += size;
+            if (prefetcher != nullptr) prefetcher->SetConsumerOffset(total);
+        }
+        return total;
+    }
+
+    size_t MappedScan(const std::string &path, Consumer &consumer) {
+        MappedFile mapped_file;
+        if (!mapped_file.Open(path)) return 0;
+        mapped_file.AdviseSequential();
+        for (size_t offset = 0; offset < mapped_file.Size(); offset += BUFFERED_READ_BYTES) {
+            consumer.Consume(mapped_file.Data() + offset, std::min(BUFFERED_READ_BYTES, mapped_file.Size() - offset));
+        }
+        return mapped_file.Size();
+    }
+
+    size_t ReadaheadScan(const std::string &path, Consumer &consumer, bool use_io_uring, std::string &backend) {
+        ReadaheadOptions options;
+        options.use_io_uring = use_io_uring;
+        ReadaheadReader reader(options);
+        if (!reader.Open(path)) return 0;
+        backend = reader.Backend();
+        ConstSpan<uint8_t> block;
+        uint64_t offset = 0;
+        size_t total = 0;
+        while (reader.Next(block, offset)) {
+            consumer.Consume(block.data(), block.size());
+            total += block.size();
+        }
+        return total;
+    }
+
+    struct Method {
+        std::string name;
+        std::function<size_t(Consumer&)> scan;
+    };
+
+    void Run(const std::vector<Method> &methods, const std::string &path, uint64_t spin_ns_per_kb, bool cold) {
+        std::cout << "\n" << (cold ? "Cold" : "Warm") << " cache, " << spin_ns_per_kb << " ns/KiB of consumer work\n"
+                  << std::left << std::setw(30) << "  method" << std::right << std::setw(12) << "ms" << std::setw(12) << "MB/s" << "\n";
+        for (const auto &method : methods) {
+            if (cold && !DropCache(path)) std::cerr << "  Could not drop the page cache of " << path << "\n";
+            Consumer consumer{spin_ns_per_kb};
+            const auto start = Clock::now();
+            const size_t bytes = method.scan(consumer);
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            std::cout << "  " << std::left << std::setw(28) << method.name << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(12) << seconds * 1e3 << std::setw(12) << (seconds > 0 ? bytes / 1e6 / seconds : 0)
+                      << std::defaultfloat << std::setprecision(6) << "   (" << std::hex << consumer.checksum % 0x10000
+                      << std::dec << ")\n";
+        }
+    }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
+        std::cerr << "Usage: " << argv[0] << " [FILE] [CONSUMER_NS_PER_KIB]\n"
+                  << "  Without a file a synthetic one is written to io_bench.dat\n";
+        return 1;
+    }
+    std::string path = argc > 1 ? argv[1] : "";
+    const uint64_t spin_ns_per_kb = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+    if (path.empty()) {
+        path = "io_bench.dat";
+        synthetic::ReadoutConfig config;
+        config.num_events = 300;
+        size_t bytes = synthetic::WriteFile(path, config);
+        if (bytes == 0) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << bytes / 1e6 << " MB to " << path << std::endl;
+    } else if (!std::ifstream(path).good()) {
+        std::cerr << "Cannot read " << path << std::endl;
+        return 1;
+    }
+
+    std::string uring_backend = "io_uring", pread_backend = "pread";
+    std::vector<Method> methods = {
+        {"buffered ifstream", [&](Consumer &consumer) { return BufferedScan(path, consumer, nullptr); }},
+        {"mmap sequential", [&](Consumer &consumer) { return MappedScan(path, consumer); }},
+        {"readahead pread", [&](Consumer &consumer) { return ReadaheadScan(path, consumer, false, pread_backend); }},
+        {"readahead io_uring", [&](Consumer &consumer) { return ReadaheadScan(path, consumer, true, uring_backend); }},
+        {"buffered + prefetcher", [&](Consumer &consumer) {
+            FilePrefetcher prefetcher;
+            prefetcher.Start(path, 0, ReadaheadReader::WHOLE_FILE, true);
+            size_t bytes = BufferedScan(path, consumer, &prefetcher);
+            prefetcher.Stop();
+            return bytes;
+        }},
+    };
+
+    Run(methods, path, spin_ns_per_kb, true);
+    Run(methods, path, spin_ns_per_kb, false);
+    // Without liburing, or if the kernel refused a ring, the io_uring row used the pread threads
+    std::cout << "\nio_uring row backend: " << uring_backend << std::endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+//
+// Compares the double and integer-only arithmetic for the minimal summary, checks
+// they give identical sums and metrics and times both on this CPU.
+//
+
+#include "synthetic_readout.h"
+#include "charge_algs.h"
+#include "light_algs.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+template <typename Math>
+double TimeSummary(const std::vector<FlatEvent> &events, size_t num_passes, ChargeSummary &summary) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < num_passes; pass++) {
+        for (const auto &event : events) ChargeAlgs::MinimalSummary<Math>(event, summary);
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Math>
+double TimeFinish(const ChargeSummary &summary, size_t num_passes, std::vector<uint32_t> &out) {
+    // The per channel finishing step of UpdateMinimalMetrics, without the metric class
+    auto start = std::chrono::steady_clock::now();
+    for (size_t pass = 0; pass < num_passes; pass++) {
+        out.clear();
+        for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) {
+            out.push_back(Math::Mean(summary.baseline[ch], summary.num_events * ChargeSummary::MEAN_SCALE));
+            out.push_back(Math::ScaledRms(summary.variance[ch], summary.num_events * ChargeSummary::VARIANCE_SCALE, 15));
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    size_t num_events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    size_t num_passes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+    // Charge only events shaped like the readout, 3 frames per channel
+    synthetic::ReadoutConfig config;
+    config.num_light_rois = 0;
+    std::mt19937 gen(config.seed);
+    EventStruct decoded;
+    std::vector<FlatEvent> events(num_events);
+    for (auto &event : events) {
+        synthetic::MakeEvent(config, gen, decoded);
+        event.Fill(decoded);
+    }
+
+    std::cout << "Sample kernels: " << kernels::ActiveKernels().isa << std::endl;
+    ChargeSummary double_summary, integer_summary;
+    double double_s = TimeSummary<metric_math::DoubleMath>(events, num_passes, double_summary);
+    double integer_s = TimeSummary<metric_math::IntegerMath>(events, num_passes, integer_summary);
+    size_t total_events = num_events * num_passes;
+    std::cout << "summary, double:  " << total_events / double_s << " events/s" << std::endl;
+    std::cout << "summary, integer: " << total_events / integer_s << " events/s" << std::endl;
+
+    bool same = double_summary.charge_hits == integer_summary.charge_hits &&
+                double_summary.baseline == integer_summary.baseline &&
+                double_summary.variance == integer_summary.variance;
+
+    constexpr size_t FINISH_PASSES = 100000;
+    std::vector<uint32_t> double_out, integer_out;
+    double double_f = TimeFinish<metric_math::DoubleMath>(double_summary, FINISH_PASSES, double_out);
+    double integer_f = TimeFinish<metric_math::IntegerMath>(integer_summary, FINISH_PASSES, integer_out);
+    std::cout << "finish, double:  " << 1e6 * double_f / FINISH_PASSES << " us/summary" << std::endl;
+    std::cout << "finish, integer: " << 1e6 * integer_f / FINISH_PASSES << " us/summary" << std::endl;
+    same = same && double_out == integer_out;
+
+    std::cout << (same ? "Outputs identical" : "OUTPUTS DIFFER") << std::endl;
+    return same ? 0 : 1;
+}
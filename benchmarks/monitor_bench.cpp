@@ -0,0 +1,221 @@
+//
+// Per-stage throughput and allocations of the minimal summary and single event queries, on a
+// generated synthetic file or end to end through the decoder on a recorded one. The synthetic
+// payload is not the readout format, its decode and flatten stages time the surrogate decoder.
+//
+
+#include "synthetic_readout.h"
+#include "alloc_counter.h"
+#include "monitor_pipeline.h"
+#include "monitor_query.h"
+#include "event_index.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Stage {
+        std::string name;
+        double seconds = 0;
+        size_t allocs = 0;
+    };
+
+    template <typename Fn>
+    void Time(Stage &stage, Fn &&fn) {
+        const size_t start_allocs = data_monitor::NumAllocations();
+        const auto start = Clock::now();
+        fn();
+        stage.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        stage.allocs += data_monitor::NumAllocations() - start_allocs;
+    }
+
+    void Report(const char *query, const std::vector<Stage> &stages, size_t num_events, size_t bytes) {
+        double total_s = 0;
+        std::cout << "\n" << query << ", " << num_events << " events, " << bytes / 1e6 << " MB\n"
+                  << std::left << std::setw(22) << "  stage" << std::right << std::setw(12) << "total ms"
+                  << std::setw(12) << "us/event" << std::setw(14) << "allocs/event" << "\n";
+        for (const auto &stage : stages) {
+            total_s += stage.seconds;
+            std::cout << "  " << std::left << std::setw(20) << stage.name << std::right << std::fixed << std::setprecision(2)
+                      << std::setw(12) << stage.seconds * 1e3
+                      << std::setw(12) << stage.seconds * 1e6 / std::max<size_t>(num_events, 1)
+                      << std::setw(14) << static_cast<double>(stage.allocs) / std::max<size_t>(num_events, 1) << "\n";
+        }
+        std::cout << "  total: " << (total_s > 0 ? num_events / total_s : 0) << " events/s, "
+                  << (total_s > 0 ? bytes / 1e6 / total_s : 0) << " MB/s" << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+
+    // Names for the report, one per algorithm in MinimalPipeline
+    struct AlgName {
+        uint32_t alg_id;
+        const char *name;
+    };
+    const AlgName ALG_NAMES[] = {
+        {ChargeSummaryAlg::ALG_ID, "charge summary"},
+        {LightSummaryAlg::ALG_ID, "light summary"},
+        {AdcHistogramAlg::ALG_ID, "adc histogram"},
+        {HitFinderAlg::ALG_ID, "hit finder"},
+        {LightPulseAlg::ALG_ID, "light pulses"},
+    };
+
+    // Same stages as a minimal summary query, run serially so each one can be timed
+    void MinimalQueryBench(const data_monitor::MappedFile &file, const data_monitor::EventIndex &index, size_t num_events) {
+        std::vector<Stage> stages{{"decode"}, {"flatten"}};
+        for (const auto &alg : ALG_NAMES) stages.push_back({alg.name});
+        stages.push_back({"finish"});
+
+        MinimalPipeline pipeline;
+        MinimalPipeline::Partials summary;
+        EventStruct event;
+        FlatEvent flat_event;
+        LowBwTpcMonitor lbw_metrics;
+        TpcMonitor metrics;
+        std::vector<AlgMetric> alg_metrics;
+        size_t bytes = 0;
+        for (size_t evt = 0; evt < num_events; evt++) {
+            const WordSpan words = index.EventWords(file, evt);
+            bytes += words.size() * sizeof(uint32_t);
+            Time(stages[0], [&]() { synthetic::DecodeEvent(words, event); });
+            Time(stages[1], [&]() { flat_event.Fill(event); });
+            for (size_t a = 0; a < std::size(ALG_NAMES); a++) {
+                Time(stages[2 + a], [&]() { pipeline.ProcessEvent(flat_event, summary, ALG_NAMES[a].alg_id); });
+            }
+        }
+        Time(stages.back(), [&]() {
+            pipeline.UpdateMetrics(summary, lbw_metrics, metrics);
+            auto lbw_vec = lbw_metrics.serialize();
+            pipeline.SerializeMetrics(summary, {0, 0, static_cast<uint32_t>(num_events)}, alg_metrics);
+        });
+        Report("Minimal summary query", stages, num_events, bytes);
+    }
+
+    // Same stages as a single event query, repeated over the file to get a stable time. The channel
+    // selection is what the query keeps, a random event query keeps one charge channel. The synthetic
+    // decoder also skips the other waveforms, the readout decoder doesn't, so with a selection the
+    // decode stage is what a selective decoder could reach rather than what the monitor spends.
+    void EventQueryBench(const data_monitor::MappedFile &file, const data_monitor::EventIndex &index, size_t num_events,
+                         const ChannelSelection &selection, const char *query) {
+        std::vector<Stage> stages{{"seek"}, {"decode"}, {"flatten"}, {"waveforms"}, {"hit finder"},
+                                  {"light pulses"}, {"raw metrics"}, {"compressed metrics"}};
+        ChargeAlgs charge_algs;
+        TpcMonitorChargeEvent charge_event_metric;
+        HitList hit_list;
+        LightPulseList pulse_list;
+        EventStruct event;
+        FlatEvent flat_event;
+        std::vector<uint32_t> metric_vec;
+        size_t bytes = 0;
+        for (size_t evt = 0; evt < num_events; evt++) {
+            WordSpan words;
+            Time(stages[0], [&]() { words = index.EventWords(file, evt); });
+            bytes += words.size() * sizeof(uint32_t);
+            Time(stages[1], [&]() { synthetic::DecodeEvent(words, event, selection); });
+            Time(stages[2], [&]() { flat_event.Fill(event, selection); });
+            Time(stages[3], [&]() { charge_algs.GetChargeEvent(flat_event); });
+            Time(stages[4], [&]() { HitFinder::FindHits(flat_event, hit_list); });
+            Time(stages[5], [&]() { LightPulseFinder::FindPulses(flat_event, pulse_list); });
+            Time(stages[6], [&]() {
+                for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) {
+                    if (selection.Charge(static_cast<uint16_t>(ch))) metric_vec = charge_algs.UpdateChargeEvent(charge_event_metric, ch);
+                }
+            });
+            Time(stages[7], [&]() {
+                for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) {
+                    if (!selection.Charge(static_cast<uint16_t>(ch))) continue;
+                    metric_vec.clear();
+                    charge_algs.EncodeChargeEvent(ch, metric_vec);
+                }
+            });
+            charge_algs.Clear();
+        }
+        Report(query, stages, num_events, bytes);
+    }
+
+    // Whole queries through the decoder, the scheduler and the metric path on a recorded file
+    int EndToEndBench(const std::string &path, uint32_t num_events) {
+        const size_t slash = path.find_last_of('/');
+        uint32_t run = 0, file = 0;
+        if (!data_monitor::MonitorQuery::ParseDataFileName(slash == std::string::npos ? path : path.substr(slash + 1), run, file)) {
+            std::cerr << path << " is not a pGRAMS_bin_<run>_<file>.dat readout file" << std::endl;
+            return 1;
+        }
+        data_monitor::QueryOptions options;
+        options.data_dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+
+        data_monitor::WorkerPool worker_pool;
+        size_t sent_bytes = 0, sent_metrics = 0;
+        auto sender = [&](std::vector<uint32_t> &metric_vec, uint32_t) {
+            sent_bytes += metric_vec.size() * sizeof(uint32_t);
+            sent_metrics++;
+        };
+        using QueryType = data_monitor::MonitorQuery::QueryType;
+        for (auto type : {QueryType::kMinimal, QueryType::kEvent}) {
+            // Stride 1 over the requested events, or the requested event with a fixed channel
+            std::vector<uint32_t> args = {run, file, type == QueryType::kMinimal ? num_events : num_events - 1, 0};
+            sent_bytes = sent_metrics = 0;
+            data_monitor::MonitorQuery query(type, args, worker_pool, sender, options);
+            Stage stage{"run"};
+            Time(stage, [&]() { query.Run(); });
+            std::cout << (type == QueryType::kMinimal ? "Minimal" : "Event") << " query: "
+                      << query.EventsProcessed() << " events in " << stage.seconds * 1e3 << " ms, "
+                      << (stage.seconds > 0 ? query.EventsProcessed() / stage.seconds : 0) << " events/s, "
+                      << stage.allocs << " allocs, sent " << sent_metrics << " metrics / " << sent_bytes << " B" << std::endl;
+        }
+        return 0;
+    }
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--query") == 0) {
+        if (argc < 3) {
+            std::cerr << "Usage: " << argv[0] << " --query <DATA_FILE> [NUM_EVT]\n";
+            return 1;
+        }
+        auto num_events = static_cast<uint32_t>(argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 100);
+        return EndToEndBench(argv[2], std::max<uint32_t>(num_events, 1));
+    }
+
+    synthetic::ReadoutConfig config;
+    config.num_events = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 500;
+    const std::string path = argc > 2 ? argv[2] : "monitor_bench.dat";
+    // A given file is reused as is, so the same input can be compared across builds
+    if (argc <= 2 || !std::ifstream(path).good()) {
+        std::cout << "Generating " << config.num_events << " events in " << path << std::endl;
+        if (synthetic::WriteFile(path, config) == 0) return 1;
+    }
+
+    data_monitor::MappedFile file;
+    data_monitor::EventIndex index;
+    Stage index_stage{"map & index"};
+    bool indexed = false;
+    Time(index_stage, [&]() { indexed = file.Open(path) && index.Build(file); });
+    if (!indexed || index.NumEvents() == 0) {
+        std::cerr << "Failed to index " << path << std::endl;
+        return 1;
+    }
+    std::cout << "Indexed " << index.NumEvents() << " events, " << file.Size() / 1e6 << " MB in "
+              << index_stage.seconds * 1e3 << " ms (" << file.Size() / 1e6 / index_stage.seconds << " MB/s)" << std::endl;
+
+    const size_t num_events = index.NumEvents();
+    std::cout << "Decode and flatten stages use the synthetic surrogate decoder, not the readout decoder,\n"
+                 "use --query <DATA_FILE> on a recorded file for the readout decoder" << std::endl;
+    MinimalQueryBench(file, index, num_events);
+    EventQueryBench(file, index, num_events, ChannelSelection::All(), "Single event query");
+    ChannelSelection one_channel;
+    one_channel.Clear();
+    one_channel.SelectCharge(NUM_CHARGE_CHANNELS / 2);
+    one_channel.SelectAllLight();
+    EventQueryBench(file, index, num_events, one_channel, "Random single channel event query");
+    return 0;
+}
@@ -0,0 +1,173 @@
+//
+// Synthetic readout files for benchmarks, XMIT framed events with configurable noise and pulses.
+//
+
+#include "synthetic_readout.h"
+#include "event_index.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+namespace synthetic {
+
+namespace {
+
+    uint16_t Clamp(double sample) {
+        return static_cast<uint16_t>(std::clamp(std::lround(sample), 0L, static_cast<long>(MAX_SAMPLE)));
+    }
+
+    void FillWaveform(std::vector<uint16_t> &samples, size_t num_samples, double baseline, double pulse_rate,
+                      const ReadoutConfig &config, std::mt19937 &gen) {
+        std::normal_distribution<double> noise(baseline, config.noise_rms);
+        samples.resize(num_samples);
+        for (auto &s : samples) s = Clamp(noise(gen));
+        if (num_samples <= config.pulse_width) return;
+        // Triangular pulses rising over the first third of their width
+        std::poisson_distribution<int> num_pulses(pulse_rate);
+        std::uniform_int_distribution<size_t> start(0, num_samples - config.pulse_width - 1);
+        const size_t rise = std::max<size_t>(config.pulse_width / 3, 1);
+        for (int p = num_pulses(gen); p > 0; p--) {
+            const size_t t0 = start(gen);
+            for (size_t k = 0; k < config.pulse_width; k++) {
+                double shape = k < rise ? static_cast<double>(k + 1) / rise
+                                        : static_cast<double>(config.pulse_width - k) / (config.pulse_width - rise);
+                samples[t0 + k] = Clamp(samples[t0 + k] + shape * config.pulse_amplitude);
+            }
+        }
+    }
+
+    void PackSamples(const std::vector<uint16_t> &samples, std::vector<uint32_t> &out) {
+        for (size_t i = 0; i < samples.size(); i += 2) {
+            uint32_t low = std::min(samples[i], MAX_SAMPLE);
+            uint32_t high = i + 1 < samples.size() ? std::min(samples[i + 1], MAX_SAMPLE) : 0;
+            out.push_back(high << 16 | low);
+        }
+    }
+
+    bool UnpackSamples(WordSpan words, size_t &pos, size_t num_samples, std::vector<uint16_t> &samples) {
+        const size_t num_words = (num_samples + 1) / 2;
+        if (pos + num_words > words.size()) return false;
+        samples.resize(num_samples);
+        for (size_t i = 0; i < num_samples; i++) {
+            uint32_t word = words[pos + i / 2];
+            samples[i] = static_cast<uint16_t>(i % 2 == 0 ? word & 0xFFFF : word >> 16);
+        }
+        pos += num_words;
+        return true;
+    }
+
+    // Step over a waveform using only its header's sample count
+    bool SkipSamples(WordSpan words, size_t &pos, size_t num_samples) {
+        const size_t num_words = (num_samples + 1) / 2;
+        if (pos + num_words > words.size()) return false;
+        pos += num_words;
+        return true;
+    }
+
+} // namespace
+
+    void MakeEvent(const ReadoutConfig &config, std::mt19937 &gen, EventStruct &event) {
+        event.charge_channel.resize(config.num_charge_channels);
+        event.charge_adc.resize(config.num_charge_channels);
+        for (size_t ch = 0; ch < config.num_charge_channels; ch++) {
+            event.charge_channel[ch] = static_cast<uint16_t>(ch);
+            FillWaveform(event.charge_adc[ch], config.charge_samples, config.charge_baseline, config.charge_pulse_rate, config, gen);
+        }
+        event.light_channel.resize(config.num_light_rois);
+        event.light_trigger_id.resize(config.num_light_rois);
+        event.light_adc.resize(config.num_light_rois);
+        for (size_t roi = 0; roi < config.num_light_rois; roi++) {
+            event.light_channel[roi] = static_cast<uint16_t>(roi % NUM_LIGHT_CHANNELS);
+            // Alternate unbiased beam gate readout and cosmic discriminator ROIs
+            event.light_trigger_id[roi] = roi % 2 == 0 ? BEAM_GATE_DISC_ID : COSMIC_DISC_ID;
+            double rate = event.light_trigger_id[roi] == COSMIC_DISC_ID ? config.light_pulse_rate : 0.0;
+            FillWaveform(event.light_adc[roi], config.light_roi_samples, config.light_baseline, rate, config, gen);
+        }
+    }
+
+    void EncodeEvent(const EventStruct &event, uint32_t event_number, std::vector<uint32_t> &out) {
+        out.push_back(data_monitor::EVENT_START_WORD);
+        out.push_back(event_number);
+        out.push_back(static_cast<uint32_t>(event.charge_channel.size()) << 16 | static_cast<uint32_t>(event.light_channel.size()));
+        for (size_t i = 0; i < event.charge_channel.size(); i++) {
+            out.push_back(CHARGE_TAG << 28 | uint32_t{event.charge_channel[i]} << 16 |
+                          static_cast<uint32_t>(event.charge_adc[i].size() & 0xFFFF));
+            PackSamples(event.charge_adc[i], out);
+        }
+        for (size_t i = 0; i < event.light_channel.size(); i++) {
+            out.push_back(LIGHT_TAG << 28 | (uint32_t{event.light_trigger_id[i]} & 0xF) << 24 |
+                          (uint32_t{event.light_channel[i]} & 0xFF) << 16 | static_cast<uint32_t>(event.light_adc[i].size() & 0xFFFF));
+            PackSamples(event.light_adc[i], out);
+        }
+        out.push_back(data_monitor::EVENT_END_WORD);
+    }
+
+    bool DecodeEvent(WordSpan words, EventStruct &event, const ChannelSelection &selection) {
+        if (words.size() < 4 || words[0] != data_monitor::EVENT_START_WORD) return false;
+        const size_t num_charge = words[2] >> 16;
+        const size_t num_light = words[2] & 0xFFFF;
+        // Sized for everything, trimmed to what the selection kept
+        event.charge_channel.resize(num_charge);
+        event.charge_adc.resize(num_charge);
+        event.light_channel.resize(num_light);
+        event.light_trigger_id.resize(num_light);
+        event.light_adc.resize(num_light);
+        size_t pos = 3, kept_charge = 0, kept_light = 0;
+        for (size_t i = 0; i < num_charge; i++) {
+            if (pos >= words.size() || words[pos] >> 28 != CHARGE_TAG) return false;
+            const uint32_t header = words[pos++];
+            const auto channel = static_cast<uint16_t>(header >> 16 & 0xFFF);
+            if (!selection.Charge(channel)) {
+                if (!SkipSamples(words, pos, header & 0xFFFF)) return false;
+                continue;
+            }
+            event.charge_channel[kept_charge] = channel;
+            if (!UnpackSamples(words, pos, header & 0xFFFF, event.charge_adc[kept_charge++])) return false;
+        }
+        for (size_t i = 0; i < num_light; i++) {
+            if (pos >= words.size() || words[pos] >> 28 != LIGHT_TAG) return false;
+            const uint32_t header = words[pos++];
+            const auto channel = static_cast<uint16_t>(header >> 16 & 0xFF);
+            if (!selection.Light(channel)) {
+                if (!SkipSamples(words, pos, header & 0xFFFF)) return false;
+                continue;
+            }
+            event.light_trigger_id[kept_light] = static_cast<uint16_t>(header >> 24 & 0xF);
+            event.light_channel[kept_light] = channel;
+            if (!UnpackSamples(words, pos, header & 0xFFFF, event.light_adc[kept_light++])) return false;
+        }
+        // The kept waveforms are at the front and keep their capacity for the next event
+        event.charge_channel.resize(kept_charge);
+        event.charge_adc.resize(kept_charge);
+        event.light_channel.resize(kept_light);
+        event.light_trigger_id.resize(kept_light);
+        event.light_adc.resize(kept_light);
+        return pos < words.size() && words[pos] == data_monitor::EVENT_END_WORD;
+    }
+
+    size_t WriteFile(const std::string &path, const ReadoutConfig &config) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Failed to open " << path << std::endl;
+            return 0;
+        }
+        std::mt19937 gen(config.seed);
+        EventStruct event;
+        std::vector<uint32_t> words;
+        size_t bytes = 0;
+        for (size_t evt = 0; evt < config.num_events; evt++) {
+            MakeEvent(config, gen, event);
+            words.clear();
+            EncodeEvent(event, static_cast<uint32_t>(evt), words);
+            file.write(reinterpret_cast<const char*>(words.data()), static_cast<std::streamsize>(words.size() * sizeof(uint32_t)));
+            bytes += words.size() * sizeof(uint32_t);
+        }
+        if (!file) {
+            std::cerr << "Failed to write " << path << std::endl;
+            return 0;
+        }
+        return bytes;
+    }
+
+} // synthetic
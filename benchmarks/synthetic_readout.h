@@ -0,0 +1,76 @@
+//
+// Synthetic readout files for benchmarks, XMIT framed events with configurable noise and pulses.
+//
+
+#ifndef SYNTHETIC_READOUT_H
+#define SYNTHETIC_READOUT_H
+
+#include "process_events.h"
+#include "tpc_monitor.h"
+#include "sample_span.h"
+#include "channel_selection.h"
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace synthetic {
+
+    struct ReadoutConfig {
+        size_t num_events = 1000;
+        size_t num_charge_channels = 192;
+        size_t charge_samples = 3 * 763;  // 3 frames per channel like the readout
+        size_t num_light_rois = 40;
+        size_t light_roi_samples = 30;
+        double charge_baseline = 2048.0;
+        double light_baseline = 1000.0;
+        double noise_rms = 4.0;
+        // Mean number of pulses per charge channel per event, and per light ROI
+        double charge_pulse_rate = 0.5;
+        double light_pulse_rate = 0.5;
+        uint16_t pulse_amplitude = 200;
+        size_t pulse_width = 12;
+        uint32_t seed = 1234;
+    };
+
+    /*
+     * Event layout, all 32b words:
+     *   [0]  EVENT_START_WORD
+     *   [1]  event number
+     *   [2]  number of charge channels << 16 | number of light ROIs
+     *   per charge channel:  CHARGE_TAG << 28 | channel << 16 | number of samples, then the samples 2 per word
+     *   per light ROI:       LIGHT_TAG << 28 | trigger ID << 24 | channel << 16 | number of samples, then the samples
+     *   [last]  EVENT_END_WORD
+     * Only the framing matches the readout so the index, tail reader and file I/O see real-looking
+     * files. The payload is this generator's own, samples are 12b so no payload word can look
+     * like a start or end word. Real files go through the decoder instead.
+     */
+    constexpr static uint32_t CHARGE_TAG = 0xC;
+    constexpr static uint32_t LIGHT_TAG = 0xA;
+    constexpr static uint16_t MAX_SAMPLE = 0xFFF;
+
+    // One event with gaussian noise and triangular pulses at random times
+    void MakeEvent(const ReadoutConfig &config, std::mt19937 &gen, EventStruct &event);
+
+    // Append the framed event words
+    void EncodeEvent(const EventStruct &event, uint32_t event_number, std::vector<uint32_t> &out);
+
+    /**
+    *  Unpack one framed event, start to end word inclusive, reusing the event's vectors.
+    *  Waveforms outside the selection are stepped over by their headers and left out of the event.
+    *
+    * @return  False if the words are not a synthetic event
+    */
+    bool DecodeEvent(WordSpan words, EventStruct &event, const ChannelSelection &selection = ChannelSelection::All());
+
+    /**
+    *  Write a whole file, one event at a time so large files don't need to fit in memory.
+    *
+    * @return  Bytes written, 0 on failure
+    */
+    size_t WriteFile(const std::string &path, const ReadoutConfig &config);
+
+} // synthetic
+
+#endif //SYNTHETIC_READOUT_H
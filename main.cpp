@@ -3,9 +3,17 @@
 //
 
 #include "src/common/data_monitor.h"
+#include "src/common/instrumentation.h"
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include <thread>
 
+#ifdef MONITOR_INSTRUMENTATION
+// Count every allocation in the monitor for the self-monitoring metric
+#include "src/common/alloc_counter.h"
+#endif
+
 // Gets user input safely.
 int GetUserInput() {
     int choice;
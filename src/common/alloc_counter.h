@@ -0,0 +1,34 @@
+//
+// Counts heap allocations for the benchmarks and the instrumented monitor. This replaces the global
+// operator new and delete, so include it in exactly one source file of an executable.
+//
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include "instrumentation.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace data_monitor {
+
+    // operator new calls from every thread since the program started
+    inline std::atomic<size_t> num_allocations{0};
+
+    inline size_t NumAllocations() { return num_allocations.load(std::memory_order_relaxed); }
+
+} // data_monitor
+
+void* operator new(size_t size) {
+    data_monitor::num_allocations.fetch_add(1, std::memory_order_relaxed);
+    // Also in the self-monitoring metric when the instrumentation is compiled in
+    MONITOR_COUNT(kAllocations, 1);
+    if (void *ptr = std::malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+#endif //ALLOC_COUNTER_H
@@ -3,8 +3,12 @@
 //
 
 #include "data_monitor.h"
-#include <iostream>
+#include "simd_kernels.h"
+#include "instrumentation.h"
+#include "logger.h"
 #include <random>
+#include <algorithm>
+#include <memory>
 
 namespace data_monitor {
 
@@ -16,31 +20,33 @@ namespace data_monitor {
     event_distrib_(event_min, event_max),
     charge_channel_distrib_(charge_min,charge_max),
     light_channel_distrib_(light_min, light_max),
-    light_algs_(),
-    charge_algs_(),
-    debug_(true)
+    is_running_(is_running),
+    debug_(true),
+    scheduler_(MAX_CONCURRENT_QUERIES),
+    live_monitor_([this](std::vector<uint32_t> &metric_vec, uint32_t metric_id) { SendMetric(metric_vec, metric_id); })
     {
-        std::cout << "DM" << std::endl;
+        LOG_INFO("DM");
         command_client_ = std::make_shared<TCPConnection>(io_context, ip_address, command_port, is_server, true, false);
         status_client_ = std::make_shared<TCPConnection>(io_context, ip_address, status_port, is_server, false, true);
         command_client_->Start();
         status_client_->Start();
         // command_client_.Start();
         // status_client_.Start();
-        process_events_ = std::make_unique<ProcessEvents>(light_slot_, false, std::vector<uint16_t>(), false);
-        process_events_->UseEventStride(true);
-        std::cout << "DM End" << std::endl;
+        LOG_INFO("Sample kernels: {}", kernels::ActiveKernels().isa);
+        LOG_INFO("DM End");
     }
 
     DataMonitor::~DataMonitor() {
-        // TODO make sure this doesn't leak memory
-        // if this class is destructed with an open file
-        process_events_.reset();
+        // Queries still running stop at their next event, the scheduler joins them
+        scheduler_.CancelAll();
+        live_monitor_.Stop();
     }
 
     void DataMonitor::SetRunning(const bool run) {
         is_running_.store(run);
         if (!run) {
+            scheduler_.CancelAll();
+            live_monitor_.Stop();
             command_client_->setStopCmdRead();
             status_client_->setStopCmdRead();
         }
@@ -58,69 +64,100 @@ namespace data_monitor {
         }
     }
 
-    void DataMonitor::setNumEvent(std::vector<uint32_t> &args) {
-        uint32_t num_events_ = args.at(2);
-        event_stride_ = args.at(3);
-        event_stride_ = event_stride_ == 0 ? event_stride_ + 1 : event_stride_;
-        process_num_events_ = num_events_ * event_stride_;
-        // 5k events per file so return error if requesting more
-        // TODO set error bit
-        if (process_num_events_ > 5000) process_num_events_ = 5000;
-    }
-
-    void DataMonitor::setEventNumber(std::vector<uint32_t> &args) {
-        uint32_t event_number = args.at(2);
-        event_stride_ = event_number;
-        event_stride_ = event_stride_ == 0 ? event_stride_ + 1 : event_stride_;
-        process_num_events_ = event_number + 1;
-        // TODO set error bit
-        if (process_num_events_ > 5000) process_num_events_ = 5000;
-    }
-
-    void DataMonitor::setFileName(std::vector<uint32_t> &args) {
-        //std::string base_path("/home/pgrams/data/nov2025_integration_data/readout_data/");
-        //std::string base_path("/home/pgrams/data/readout_data/");
-        std::string base_path("/home/pgrams/data/jan13_integration/readout_data/");
-        run_number_ = args.at(0);
-        file_number_ = args.at(1);
-        monitor_file_ = base_path + "pGRAMS_bin_" + std::to_string(run_number_) + "_" + std::to_string(file_number_) + ".dat";
-        std::cout << "Requested file: " << monitor_file_ << std::endl;
-    }
-
     void DataMonitor:: HandleCommand(Command& cmd) {
-        std::cout << "Received command: 0x" << std::hex << cmd.command << std::dec << std::endl;
+        LOG_INFO("Received command: 0x{:x}", cmd.command);
         switch (cmd.command) {
             case static_cast<int>(CommunicationCodes::TPCMonitor_Query_LB_Data): {
-                // Create file name
+                // args: run, file, number of events, stride, optional algorithm mask (MinimalPipeline ALG_IDs)
                 if (cmd.arguments.size() < 4) break;
-                setFileName(cmd.arguments);
-                setNumEvent(cmd.arguments);
-                // Set the functions to process events, create metrics and update them
-                // since the class members have an implicit this pointer to the current instance of the
-                // class we have to make it explicit with a lambda function. Repeated for each case below.
-                metric_creator_ = [this](EventStruct& evt) { this->CreateMinimalMetrics(evt); };
-                update_metrics_ = [this](size_t evt_number) { this->UpdateMinimalMetrics(evt_number); };
-                ProcessFile();
+                SubmitQuery(MonitorQuery::QueryType::kMinimal, cmd.arguments);
                 break;
             }
             case static_cast<int>(CommunicationCodes::TPCMonitor_Query_Event_Data): {
-                // Create file name
+                // args: run, file, event number, random channel flag
                 if (cmd.arguments.size() < 4) break;
-                setFileName(cmd.arguments);
-                // We want to take one stride to the event we want, process it and quit.
-                setEventNumber(cmd.arguments);
-                choose_random_ = cmd.arguments.at(3) == 1;
-
-                metric_creator_ = [this](EventStruct& evt) { this->CreateEventMetrics(evt); };
-                update_metrics_ = [this](size_t evt_number) { this->UpdateEventMetrics(evt_number); };
-                ProcessFile();
+                SubmitQuery(MonitorQuery::QueryType::kEvent, cmd.arguments);
+                break;
+            }
+            case kRunScan: {
+                // args: run, first file, last file (0 = through the last), events per file (0 = all), stride,
+                // optional 1 to also send each file's LBW
+                if (cmd.arguments.size() < 5) break;
+                SubmitQuery(MonitorQuery::QueryType::kRunScan, cmd.arguments);
+                break;
+            }
+            case kStopDecoder: {
+                // args: job ID, none or 0 cancels every queued and running query
+                uint32_t job_id = cmd.arguments.empty() ? 0 : cmd.arguments.at(0);
+                if (job_id == 0) {
+                    scheduler_.CancelAll();
+                } else if (!scheduler_.Cancel(job_id)) {
+                    LOG_WARNING("No active job: {}", job_id);
+                }
+                break;
+            }
+            case kQueryStatus: {
+                SendJobStatus();
+                break;
+            }
+            case kInstrumentation: {
+                // args: optional 1 to start counting again after this report
+                SendInstrumentation(!cmd.arguments.empty() && cmd.arguments.at(0) == 1);
+                break;
+            }
+            case kSetCacheBudget: {
+                // args: result cache size in KiB, optional summary partial store size in KiB, 0 disables either
+                if (cmd.arguments.empty()) break;
+                result_cache_.SetBudget(static_cast<size_t>(cmd.arguments.at(0)) * 1024);
+                LOG_INFO("Result cache: {} KiB, {} entries, {} hits, {} misses", cmd.arguments.at(0), result_cache_.NumEntries(),
+                         result_cache_.Hits(), result_cache_.Misses());
+                if (cmd.arguments.size() < 2) break;
+                summary_store_.SetBudget(static_cast<size_t>(cmd.arguments.at(1)) * 1024);
+                LOG_INFO("Summary store: {} KiB, {} events", cmd.arguments.at(1), summary_store_.NumEvents());
                 break;
             }
             case kDecodeEvent: {
                 break;
             }
+            case kSetEventEncoding: {
+                // args: 0 = raw samples, 1 = compressed waveforms
+                if (cmd.arguments.empty()) break;
+                query_options_.compress_events = cmd.arguments.at(0) == 1;
+                LOG_INFO("Event encoding: {}", query_options_.compress_events ? "compressed" : "raw");
+                break;
+            }
+            case kSetHistogramFormat: {
+                // args: 0 = dense, 1 = sparse ADC histogram payload
+                if (cmd.arguments.empty()) break;
+                query_options_.histogram_format = cmd.arguments.at(0) == 0 ? HistogramFormat::kDense : HistogramFormat::kSparse;
+                LOG_INFO("Histogram format: {}", cmd.arguments.at(0) == 0 ? "dense" : "sparse");
+                break;
+            }
+            case kSetLinkBudget: {
+                // args: downlink bytes/s (0 = unlimited), max batch bytes, batch events (0/1)
+                if (cmd.arguments.size() < 3) break;
+                SetLinkBudget(cmd.arguments.at(0), cmd.arguments.at(1), cmd.arguments.at(2) == 1);
+                break;
+            }
+            case kLiveMonitor: {
+                // args: enable (0/1), run, window size in events (capped at MAX_WINDOW_EVENTS), push interval in ms
+                if (cmd.arguments.empty()) break;
+                if (cmd.arguments.at(0) == 0 || cmd.arguments.size() < 4) {
+                    live_monitor_.Stop();
+                    LOG_INFO("Live monitor stopped after {} events", live_monitor_.EventsProcessed());
+                    break;
+                }
+                LiveOptions options;
+                options.run_number = cmd.arguments.at(1);
+                options.window_events = cmd.arguments.at(2);
+                options.push_interval_ms = cmd.arguments.at(3);
+                options.histogram_format = query_options_.histogram_format;
+                options.debug = debug_.load();
+                live_monitor_.Start(options);
+                break;
+            }
             default: {
-                std::cerr << "Unknown command: 0x" << std::hex << cmd.command << std::dec << std::endl;
+                LOG_ERROR("Unknown command: 0x{:x}", cmd.command);
             }
         }
     }
@@ -132,7 +169,7 @@ namespace data_monitor {
                 break;
             }
             default: {
-                std::cerr << "Unknown charge metric: 0x" << std::hex << charge_metric << std::dec << std::endl;
+                LOG_ERROR("Unknown charge metric: 0x{:x}", charge_metric);
             }
         }
         switch (light_metric) {
@@ -140,124 +177,71 @@ namespace data_monitor {
                 break;
             }
             default: {
-                std::cerr << "Unknown light metric: 0x" << std::hex << charge_metric << std::dec << std::endl;
+                LOG_ERROR("Unknown light metric: 0x{:x}", charge_metric);
             }
         }
     }
 
-    void DataMonitor::ProcessFile() {
-        // if (!OpenFile()) { return; }
-        if (!process_events_->OpenFile(monitor_file_)) {
-            std::cerr << "Failed to load file!" << std::endl;
-        }
-        GetEventMetrics();
-    }
-
-    void DataMonitor::GetEventMetrics() {
-        if (debug_) std::cout << "entering processing" << std::endl;
-        // Set the decoder stride. When requesting 1 event we want to make one stride directly to the
-        // desired event. This is because in the decoder striding skips filling the data structure for
-        // the intermediate events. Thus, it is more efficient to stride than to get each event.
-        process_events_->SetEventStride(event_stride_);
-
-        // Loop through desired events, either adjacent events or with some stride
-        size_t event_count = 0;
-        while (process_events_->GetEvent() && (event_count < process_num_events_) && (event_count < EVENT_LOOP_MAX)) {
-            // the decoder must iterate through each event since we don't know a priori the event size
-            if ((event_count % event_stride_) != 0 || (event_count == 0 && process_num_events_ != 1)) {
-                event_count++;
-                continue;
-            }
-            if (debug_) std::cout << "Processing event: " << event_count << std::endl;
-            EventStruct evt_data = process_events_->GetEventStruct();
-            // Calculate event metrics
-            metric_creator_(evt_data);
-            event_count++;
+    uint32_t DataMonitor::SubmitQuery(MonitorQuery::QueryType type, const std::vector<uint32_t> &args) {
+        // Snapshot the settings, later commands don't change a query already submitted
+        QueryOptions options = query_options_;
+        options.debug = debug_.load();
+        options.random_seed = random_generator_();
+        auto sender = [this](std::vector<uint32_t> &metric_vec, uint32_t metric_id) { SendMetric(metric_vec, metric_id); };
+        auto query = std::make_unique<MonitorQuery>(type, args, worker_pool_, sender, options, &result_cache_, &summary_store_,
+                                                     &next_file_prefetcher_);
+        uint32_t job_id = scheduler_.Submit(std::move(query));
+        LOG_INFO("Queued job {}", job_id);
+        return job_id;
+    }
+
+    void DataMonitor::SendJobStatus() {
+        auto jobs = scheduler_.Status();
+        std::vector<uint32_t> status_vec;
+        status_vec.reserve(1 + 4 * jobs.size());
+        status_vec.push_back(jobs.size());
+        for (const auto &job : jobs) {
+            status_vec.push_back(job.id);
+            status_vec.push_back(static_cast<uint32_t>(job.state));
+            status_vec.push_back(job.events_processed);
+            status_vec.push_back(job.events_selected);
         }
-        // The number of desired events have been processed and metrics created
-        // so update the metrics and send them
-        update_metrics_(event_count);
-    }
-
-    void DataMonitor::SendMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id) {
+        SendMetric(status_vec, QUERY_STATUS_METRIC, false);
+    }
+
+    void DataMonitor::SendInstrumentation(bool reset) {
+        if (!instrumentation::Enabled()) LOG_WARNING("Instrumentation not compiled in, build with MONITOR_INSTRUMENTATION");
+        std::vector<uint32_t> metric_vec;
+        instrumentation::Serialize(instrumentation::Snapshot(), metric_vec);
+        if (reset) instrumentation::Reset();
+        SendMetric(metric_vec, instrumentation::INSTRUMENTATION_METRIC, false);
+    }
+
+    void DataMonitor::SetLinkBudget(uint32_t bytes_per_s, uint32_t max_batch_bytes, bool batch_events) {
+        // The bucket holds one full batch so a batch never waits on itself
+        max_batch_bytes = std::max<uint32_t>(max_batch_bytes, MIN_BATCH_BYTES);
+        link_limiter_.SetRate(bytes_per_s, max_batch_bytes);
+        // Applies to queries submitted from now on
+        query_options_.max_batch_words = max_batch_bytes / sizeof(uint32_t);
+        query_options_.batch_events = batch_events;
+        LOG_INFO("Link budget: {} B/s, batch: {} B, batching {}", bytes_per_s, max_batch_bytes, batch_events ? "on" : "off");
+    }
+
+    void DataMonitor::SendMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id, bool paced) {
+        MONITOR_TIME_SCOPE(kSendMetric);
+        MONITOR_COUNT(kMetricsSent, 1);
+        MONITOR_COUNT(kBytesSent, metric_vec.size() * sizeof(uint32_t));
+        // Pace everything on the status link to the downlink budget. The wait is outside the send
+        // lock so a paced sender never holds up another one, each waits only for its own bytes.
+        if (paced) link_limiter_.Acquire(metric_vec.size() * sizeof(uint32_t));
+        else link_limiter_.Charge(metric_vec.size() * sizeof(uint32_t));
+        // One metric on the link at a time, concurrent queries take turns
+        std::lock_guard<std::mutex> lock(send_mutex_);
         // Send the metrics
         Command lbw_cmd(metric_id, metric_vec.size());
         lbw_cmd.arguments = std::move(metric_vec);
         status_client_->WriteSendBuffer(lbw_cmd);
-        std::cout << "Sent metrics.." << std::endl;
-    }
-
-    void DataMonitor::CreateMinimalMetrics(EventStruct & event) {
-        charge_algs_.MinimalSummary(event);
-        if (debug_) std::cout << "Processed charge.." << std::endl;
-        light_algs_.MinimalSummary(event);
-        if (debug_) std::cout << "Processed light.." << std::endl;
-    }
-
-    void DataMonitor::UpdateMinimalMetrics(size_t evt_number) {
-        lbw_metrics_.setRunNumber(run_number_);
-        lbw_metrics_.setFileNumber(file_number_);
-        lbw_metrics_.setEvtNumber(0); // set to 0 since the metric is an aggregate across events
-        charge_algs_.UpdateMinimalMetrics(lbw_metrics_, metrics_);
-        if (debug_) std::cout << "Updated charge.." << std::endl;
-        light_algs_.UpdateMinimalMetrics(lbw_metrics_, metrics_);
-
-        auto tmp_vec = lbw_metrics_.serialize();
-        SendMetric(tmp_vec, 0x4001);
-
-        if (debug_) std::cout << "Updated light.." << std::endl;
-        if (debug_) lbw_metrics_.print();
-        // Clear the metrics for the next file
-        charge_algs_.Clear();
-        light_algs_.Clear();
-    }
-
-    void DataMonitor::CreateEventMetrics(EventStruct & event) {
-        charge_algs_.GetChargeEvent(event);
-        if (debug_) std::cout << "Processed charge event.." << std::endl;
-        //num_light_rois_ = light_algs_.GetLightEvent(event);
-        if (debug_) std::cout << "Processed light event.." << std::endl;
-    }
-
-    void DataMonitor::UpdateEventMetrics(size_t evt_number) {
-        if (debug_) std::cout << "Updating Event Metrics.." << std::endl;
-        charge_event_metric_.setRunNumber(run_number_);
-        charge_event_metric_.setFileNumber(file_number_);
-        charge_event_metric_.setEvtNumber(evt_number);
-        light_event_metric_.setRunNumber(run_number_);
-        light_event_metric_.setFileNumber(file_number_);
-        light_event_metric_.setEvtNumber(evt_number);
-        if (choose_random_) {
-            auto charge_uniform = std::uniform_int_distribution<size_t>(0, NUM_CHARGE_CHANNELS);
-            size_t charge_channel = charge_uniform(random_generator_);
-            if (debug_) std::cout << "Random charge ch: " << charge_channel << std::endl;
-            auto tmp_vec = charge_algs_.UpdateChargeEvent(charge_event_metric_, charge_channel);
-            SendMetric(tmp_vec, 0x4002);
-
-            auto light_uniform = std::uniform_int_distribution<size_t>(0, num_light_rois_);
-            size_t light_roi = light_uniform(random_generator_);
-            if (debug_) std::cout << "Random light roi: " << light_roi << std::endl;
-            if (light_algs_.isLightRoi()) {
-                tmp_vec = light_algs_.UpdateLightEvent(light_event_metric_, light_roi);
-                SendMetric(tmp_vec, 0x4003);
-            }
-        } else {
-            for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
-                auto tmp_vec = charge_algs_.UpdateChargeEvent(charge_event_metric_, i);
-                if (debug_) std::cout << "Updated charge event.." << std::endl;
-                SendMetric(tmp_vec, 0x4002);
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
-            for (size_t i = 0; i < num_light_rois_; i++) {
-                auto tmp_vec = light_algs_.UpdateLightEvent(light_event_metric_, i);
-                if (debug_) std::cout << "Updated light event.." << std::endl;
-                SendMetric(tmp_vec, 0x4003);
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
-        }
-        // Make sure to clear it
-        charge_algs_.Clear();
-        light_algs_.Clear();
+        LOG_DEBUG("Sent metrics..");
     }
 
 } // data_monitor
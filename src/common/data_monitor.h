@@ -7,14 +7,19 @@
 
 #include "tcp_connection.h"
 #include "CommunicationCodes.hh"
-#include "process_events.h"
-#include "light_algs.h"
-#include "charge_algs.h"
+#include "query_scheduler.h"
+#include "result_cache.h"
+#include "summary_store.h"
+#include "file_prefetcher.h"
+#include "live_monitor.h"
+#include "worker_pool.h"
+#include "rate_limiter.h"
 #include <random>
 #include <atomic>
 #include <thread>
 #include <cstdint>
 #include <functional>
+#include <mutex>
 
 namespace data_monitor {
 
@@ -29,12 +34,8 @@ public:
 
     void SetRunning(bool run);
 
-    // FIXME shoulf be private, public for testing
-    void ProcessFile();
-    void GetEventMetrics();
     void Run();
     void ReceiveCommand();
-    void SetMonitorFile(const std::string &monitor_file) { monitor_file_ = monitor_file; }
     void RunMetrics();
 
     // Expose these so we can run it from command line
@@ -42,37 +43,29 @@ public:
 
 private:
 
-    // Command/Conrol helper fucntions
-    void setFileName(std::vector<uint32_t>& args);
-    void setNumEvent(std::vector<uint32_t>& args);
-    void setEventNumber(std::vector<uint32_t>& args);
-
-    // Minimal metrics
-    void CreateMinimalMetrics(EventStruct & event);
-    void UpdateMinimalMetrics(size_t evt_number);
-
-    // Send events
-    void CreateEventMetrics(EventStruct & event);
-    void UpdateEventMetrics(size_t evt_number);
+    // Hand a query to the scheduler, returns its job ID
+    uint32_t SubmitQuery(MonitorQuery::QueryType type, const std::vector<uint32_t> &args);
+    void SendJobStatus();
+    // Per-stage timing and counters, see instrumentation.h
+    void SendInstrumentation(bool reset);
 
     void SendMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics);
-    void SendMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id);
+    // Thread safe, queries running on the scheduler all send through here. Replies from the
+    // command thread aren't paced, waiting behind query traffic would delay the next command.
+    void SendMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id, bool paced = true);
+    void SetLinkBudget(uint32_t bytes_per_s, uint32_t max_batch_bytes, bool batch_events);
     void SetMetrics(uint32_t charge_metric, uint32_t light_metric);
 
     // TCPConnection command_client_;
     // TCPConnection status_client_;
     std::shared_ptr<TCPConnection> command_client_;
     std::shared_ptr<TCPConnection> status_client_;
-    std::unique_ptr<ProcessEvents> process_events_;
-
     // Seed the random number generator
     // std::random_device rd;
     std::mt19937 random_generator_;
 
     // Create a uniform integer distribution object
-    constexpr static uint16_t light_slot_ = 16;
     const size_t events_per_file = 5;
-    std::vector<size_t> selected_events_;
     constexpr static int event_min = 0, event_max = 5000;
     constexpr static int charge_min = 0, charge_max = 188;
     constexpr static int light_min = 0, light_max = 32;
@@ -85,42 +78,55 @@ private:
 
     std::thread decode_thread_;
 
-    // The event step size, analyze every N events
-    size_t process_num_events_;
-    size_t event_stride_ = 500;
-    // Set a hard upper limit to ensure no infinite loops while decoding
-    constexpr static size_t EVENT_LOOP_MAX = 10000;
-
-    // This struct will hold the metrics
-    LowBwTpcMonitor lbw_metrics_;
-    TpcMonitor metrics_;
-    TpcMonitorChargeEvent charge_event_metric_;
-    TpcMonitorLightEvent light_event_metric_;
-
-    // Define the metric algorithm classes
-    LightAlgs light_algs_;
-    ChargeAlgs charge_algs_;
-
     uint32_t charge_metric_;
     uint32_t light_metric_;
 
-    std::string monitor_file_;
-
     enum ControlCmds : uint16_t {
         kMinimalQuery = 1,
         kStopDecoder = 2,
-        kDecodeEvent = 3
+        kDecodeEvent = 3,
+        kSetLinkBudget = 4,
+        kSetEventEncoding = 5,
+        kQueryStatus = 6,
+        kSetCacheBudget = 7,
+        kLiveMonitor = 8,
+        kSetHistogramFormat = 9,
+        kInstrumentation = 10,
+        kRunScan = 11
     };
 
-    // Function to process the data and create metrics
-    std::function<void(EventStruct&)> metric_creator_;
-    std::function<void(size_t evt_number)> update_metrics_;
+    // Job list in reply to kQueryStatus: count, then (id, state, processed, selected) per job
+    constexpr static uint32_t QUERY_STATUS_METRIC = 0x4007;
+
+    // Downlink pacing and batching of event metrics
+    constexpr static uint32_t DEFAULT_LINK_BYTES_PER_S = 64 * 1024;
+    constexpr static uint32_t DEFAULT_MAX_BATCH_BYTES = 16 * 1024;
+    constexpr static uint32_t MIN_BATCH_BYTES = 1024;
+    RateLimiter link_limiter_{DEFAULT_LINK_BYTES_PER_S, DEFAULT_MAX_BATCH_BYTES};
+    std::mutex send_mutex_;
+
+    // Settings handed to each new query, see QueryOptions
+    QueryOptions query_options_;
 
     std::atomic_bool debug_;
-    bool choose_random_ = false;
-    size_t num_light_rois_ = 0;
-    uint32_t run_number_ = 0;
-    uint32_t file_number_ = 0;
+
+    // Results of finished queries, closed files never change so a repeat query is a replay
+    constexpr static size_t DEFAULT_CACHE_BYTES = 64 * 1024 * 1024;
+    ResultCache result_cache_{DEFAULT_CACHE_BYTES};
+    // Per-event summary partials, a query for more events or another stride only decodes the new ones
+    constexpr static size_t DEFAULT_PARTIAL_BYTES = 256 * 1024 * 1024;
+    SummaryStore summary_store_{DEFAULT_PARTIAL_BYTES};
+    // Warms the start of the run's next file after each query, before the scheduler so its queries are gone first
+    FilePrefetcher next_file_prefetcher_;
+
+    // Queries that may run at once, the rest wait their turn
+    constexpr static size_t MAX_CONCURRENT_QUERIES = 2;
+    // Declared last so the workers are joined before anything they use is destroyed,
+    // the scheduler goes first since its queries submit to the pool and fill the cache
+    WorkerPool worker_pool_;
+    QueryScheduler scheduler_;
+    // Follows the file being written, sends through SendMetric so it goes before everything it uses
+    LiveMonitor live_monitor_;
 
 };
 
@@ -0,0 +1,138 @@
+//
+// Per-file event offset index for the readout .dat files.
+//
+
+#include "event_index.h"
+#include "logger.h"
+#include <sys/stat.h>
+#include <fstream>
+
+namespace data_monitor {
+
+    bool EventIndex::FileStat(const std::string &data_file, uint64_t &size, int64_t &mtime) {
+        struct stat st{};
+        if (stat(data_file.c_str(), &st) != 0) return false;
+        size = static_cast<uint64_t>(st.st_size);
+        mtime = static_cast<int64_t>(st.st_mtime);
+        return true;
+    }
+
+    void EventIndex::Clear() {
+        data_file_.clear();
+        file_size_ = 0;
+        file_mtime_ = 0;
+        entries_.clear();
+    }
+
+    bool EventIndex::LoadOrBuild(const MappedFile &file) {
+        const std::string &data_file = file.Path();
+        // Already indexed and the file has not changed since
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (data_file == data_file_ && FileStat(data_file, size, mtime) &&
+            size == file_size_ && mtime == file_mtime_) {
+            return true;
+        }
+        if (Load(data_file)) return true;
+        if (!Build(file)) return false;
+        // The index is still usable if the data directory is read-only
+        if (!Save()) LOG_WARNING("Could not write event index: {}", SidecarName(data_file));
+        return true;
+    }
+
+    bool EventIndex::Load(const std::string &data_file) {
+        Clear();
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (!FileStat(data_file, size, mtime)) return false;
+
+        const std::string sidecar = SidecarName(data_file);
+        uint64_t sidecar_size = 0;
+        int64_t sidecar_mtime = 0;
+        if (!FileStat(sidecar, sidecar_size, sidecar_mtime)) return false;
+        std::ifstream in(sidecar, std::ios::binary);
+        if (!in) return false;
+
+        uint32_t magic = 0, version = 0;
+        uint64_t idx_size = 0, num_entries = 0;
+        int64_t idx_mtime = 0;
+        in.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        in.read(reinterpret_cast<char*>(&version), sizeof(version));
+        in.read(reinterpret_cast<char*>(&idx_size), sizeof(idx_size));
+        in.read(reinterpret_cast<char*>(&idx_mtime), sizeof(idx_mtime));
+        in.read(reinterpret_cast<char*>(&num_entries), sizeof(num_entries));
+        if (!in || magic != INDEX_MAGIC || version != INDEX_VERSION) return false;
+        // Stale index, the data file was still being written when it was built
+        if (idx_size != size || idx_mtime != mtime) return false;
+        // The entry count is only trusted if the sidecar holds exactly that many entries, a torn
+        // or corrupt write is rebuilt rather than sizing an allocation from it
+        const auto header_bytes = static_cast<uint64_t>(in.tellg());
+        const uint64_t entry_bytes = sidecar_size > header_bytes ? sidecar_size - header_bytes : 0;
+        if (entry_bytes % sizeof(EventIndexEntry) != 0 || entry_bytes / sizeof(EventIndexEntry) != num_entries) {
+            LOG_WARNING("Event index {} has {} B for {} entries, rebuilding", sidecar, entry_bytes, num_entries);
+            return false;
+        }
+
+        std::vector<EventIndexEntry> entries(num_entries);
+        in.read(reinterpret_cast<char*>(entries.data()),
+                static_cast<std::streamsize>(num_entries * sizeof(EventIndexEntry)));
+        if (!in) return false;
+
+        data_file_ = data_file;
+        file_size_ = size;
+        file_mtime_ = mtime;
+        entries_ = std::move(entries);
+        return true;
+    }
+
+    bool EventIndex::Build(const MappedFile &file) {
+        Clear();
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        if (!file.IsOpen() || !FileStat(file.Path(), size, mtime)) return false;
+
+        // Scan the words straight out of the mapping, no intermediate read buffer
+        file.AdviseSequential();
+        const WordSpan words = file.Words();
+        uint64_t event_start = 0;
+        bool in_event = false;
+        for (size_t i = 0; i < words.size(); i++) {
+            const uint32_t word = words[i];
+            if (word == EVENT_START_WORD) {
+                // A start word without an end word means a truncated event, drop it
+                event_start = i;
+                in_event = true;
+            } else if (word == EVENT_END_WORD && in_event) {
+                uint64_t event_words = i - event_start + 1;
+                uint32_t trigger_word = event_words > 2 ? words[event_start + 1] : 0;
+                entries_.push_back({event_start * sizeof(uint32_t),
+                                    static_cast<uint32_t>(event_words * sizeof(uint32_t)),
+                                    trigger_word});
+                in_event = false;
+            }
+        }
+
+        data_file_ = file.Path();
+        file_size_ = size;
+        file_mtime_ = mtime;
+        return true;
+    }
+
+    bool EventIndex::Save() const {
+        if (!IsValid()) return false;
+        std::ofstream out(SidecarName(data_file_), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+
+        uint32_t magic = INDEX_MAGIC, version = INDEX_VERSION;
+        uint64_t num_entries = entries_.size();
+        out.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+        out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        out.write(reinterpret_cast<const char*>(&file_size_), sizeof(file_size_));
+        out.write(reinterpret_cast<const char*>(&file_mtime_), sizeof(file_mtime_));
+        out.write(reinterpret_cast<const char*>(&num_entries), sizeof(num_entries));
+        out.write(reinterpret_cast<const char*>(entries_.data()),
+                  static_cast<std::streamsize>(num_entries * sizeof(EventIndexEntry)));
+        return static_cast<bool>(out);
+    }
+
+} // data_monitor
@@ -0,0 +1,76 @@
+//
+// Per-file event offset index for the readout .dat files.
+//
+
+#ifndef EVENT_INDEX_H
+#define EVENT_INDEX_H
+
+#include "mapped_file.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace data_monitor {
+
+    // Readout events are framed by 32b XMIT start/end words, this is all the index needs
+    // to know about the format, the payload itself is left to the decoder.
+    constexpr static uint32_t EVENT_START_WORD = 0xFFFFFFFF;
+    constexpr static uint32_t EVENT_END_WORD = 0xE0000000;
+
+    struct EventIndexEntry {
+        uint64_t offset;       // byte offset of the event start word
+        uint32_t size;         // event size in bytes, start to end word inclusive
+        uint32_t trigger_word; // first word after the start word, carries the event/trigger number
+    };
+
+class EventIndex {
+public:
+    EventIndex() = default;
+    ~EventIndex() = default;
+
+    /**
+    *  Load the sidecar index for a data file, or scan the mapped file and write the sidecar if
+    *  there is none or it is stale (data file size or mtime changed).
+    *
+    *   @param [in] file:  The mapped readout .dat file
+    *
+    * @return  Returns true if a valid index is available, false on failure.
+    */
+    bool LoadOrBuild(const MappedFile &file);
+    bool Load(const std::string &data_file);
+    bool Build(const MappedFile &file);
+    bool Save() const;
+    void Clear();
+
+    bool IsValid() const { return !data_file_.empty(); }
+    size_t NumEvents() const { return entries_.size(); }
+    const EventIndexEntry& At(size_t event) const { return entries_.at(event); }
+    // Zero-copy view of one event's words in the mapped file
+    WordSpan EventWords(const MappedFile &file, size_t event) const {
+        return file.Words(entries_.at(event).offset, entries_.at(event).size);
+    }
+    const std::string& DataFile() const { return data_file_; }
+    uint64_t FileSize() const { return file_size_; }
+    int64_t FileMtime() const { return file_mtime_; }
+
+    static std::string SidecarName(const std::string &data_file) { return data_file + ".idx"; }
+    // Size and mtime identify a version of a data file, a file still being written changes both
+    static bool FileStat(const std::string &data_file, uint64_t &size, int64_t &mtime);
+
+private:
+
+    // Sidecar header, bump the version if the entry layout changes
+    constexpr static uint32_t INDEX_MAGIC = 0x58494750; // "PGIX"
+    constexpr static uint32_t INDEX_VERSION = 1;
+
+    std::string data_file_;
+    uint64_t file_size_ = 0;
+    int64_t file_mtime_ = 0;
+    std::vector<EventIndexEntry> entries_;
+
+};
+
+} // data_monitor
+
+#endif //EVENT_INDEX_H
@@ -0,0 +1,78 @@
+//
+// Background thread streaming a file range into the page cache ahead of a reader.
+//
+
+#include "file_prefetcher.h"
+#include "logger.h"
+#include <chrono>
+
+namespace data_monitor {
+
+    FilePrefetcher::FilePrefetcher(uint64_t max_ahead_bytes, const ReadaheadOptions &options) :
+    max_ahead_bytes_(max_ahead_bytes),
+    reader_(options)
+    {}
+
+    FilePrefetcher::~FilePrefetcher() {
+        Stop();
+    }
+
+    bool FilePrefetcher::Start(const std::string &path, uint64_t offset, uint64_t length, bool follow_consumer) {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        stop_.store(true);
+        wait_cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+
+        path_ = path;
+        bytes_read_.store(0);
+        if (!reader_.Open(path, offset, length)) {
+            LOG_WARNING("Prefetch could not open {}", path);
+            return false;
+        }
+        stop_.store(false);
+        running_.store(true);
+        consumer_offset_.store(offset);
+        thread_ = std::thread([this, offset, follow_consumer]() { Prefetch(offset, follow_consumer); });
+        return true;
+    }
+
+    void FilePrefetcher::Stop() {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        stop_.store(true);
+        wait_cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    void FilePrefetcher::SetConsumerOffset(uint64_t offset) {
+        consumer_offset_.store(offset, std::memory_order_relaxed);
+        // Only worth a wakeup once the prefetch could be waiting on it
+        if (running_.load(std::memory_order_relaxed)) wait_cv_.notify_one();
+    }
+
+    std::string FilePrefetcher::Path() const {
+        std::lock_guard<std::mutex> lock(control_mutex_);
+        return path_;
+    }
+
+    void FilePrefetcher::Prefetch(uint64_t start_offset, bool follow_consumer) {
+        ConstSpan<uint8_t> block;
+        uint64_t block_offset = start_offset;
+        while (!stop_.load()) {
+            if (follow_consumer) {
+                std::unique_lock<std::mutex> lock(wait_mutex_);
+                // The timeout covers a consumer that stops reporting, e.g. it reached the end of its events
+                wait_cv_.wait_for(lock, std::chrono::milliseconds(50), [&]() {
+                    return stop_.load() || reader_.NextOffset() < consumer_offset_.load() + max_ahead_bytes_;
+                });
+                if (stop_.load()) break;
+                if (reader_.NextOffset() >= consumer_offset_.load() + max_ahead_bytes_) continue;
+            }
+            // The bytes only matter for landing in the page cache
+            if (!reader_.Next(block, block_offset)) break;
+            bytes_read_.fetch_add(block.size(), std::memory_order_relaxed);
+        }
+        reader_.Close();
+        running_.store(false);
+    }
+
+} // data_monitor
@@ -0,0 +1,80 @@
+//
+// Background thread streaming a file range into the page cache ahead of a reader.
+//
+
+#ifndef FILE_PREFETCHER_H
+#define FILE_PREFETCHER_H
+
+#include "readahead_reader.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace data_monitor {
+
+/*
+ * The decoder opens and reads the file itself, so it can't be handed our buffers. Instead the
+ * range is streamed through a ReadaheadReader on a background thread and the decoder's own
+ * reads find the pages already cached. Following a consumer keeps the prefetch at most
+ * max_ahead bytes in front of it, so a slow query can't evict what it is about to read.
+ */
+class FilePrefetcher {
+public:
+    explicit FilePrefetcher(uint64_t max_ahead_bytes = DEFAULT_MAX_AHEAD_BYTES,
+                            const ReadaheadOptions &options = ReadaheadOptions());
+    ~FilePrefetcher();
+
+    FilePrefetcher(const FilePrefetcher&) = delete;
+    FilePrefetcher& operator=(const FilePrefetcher&) = delete;
+
+    /**
+    *  Start streaming a range of a file, stops the previous one first.
+    *
+    *   @param [in] path:  File to prefetch
+    *   @param [in] offset:  First byte of the range
+    *   @param [in] length:  Range length, clamped to the end of the file
+    *   @param [in] follow_consumer:  Stay within max_ahead of the offset given to SetConsumerOffset
+    *
+    * @return  Returns true if the file was opened.
+    */
+    bool Start(const std::string &path, uint64_t offset = 0, uint64_t length = ReadaheadReader::WHOLE_FILE,
+               bool follow_consumer = false);
+    // Waits for the prefetch thread, the reader's blocks are freed when it ends
+    void Stop();
+
+    // Where the consumer is reading, lets a following prefetch move on
+    void SetConsumerOffset(uint64_t offset);
+
+    bool IsRunning() const { return running_.load(); }
+    // File of the current or last prefetch
+    std::string Path() const;
+    uint64_t BytesRead() const { return bytes_read_.load(); }
+
+    constexpr static uint64_t DEFAULT_MAX_AHEAD_BYTES = 64 * 1024 * 1024;
+
+private:
+
+    void Prefetch(uint64_t start_offset, bool follow_consumer);
+
+    uint64_t max_ahead_bytes_;
+    ReadaheadReader reader_;
+    // Start and Stop can come from different queries
+    mutable std::mutex control_mutex_;
+    std::string path_;
+
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;
+    std::atomic<uint64_t> consumer_offset_{0};
+    std::atomic_bool stop_{false};
+    std::atomic_bool running_{false};
+    std::atomic<uint64_t> bytes_read_{0};
+    std::thread thread_;
+
+};
+
+} // data_monitor
+
+#endif //FILE_PREFETCHER_H
@@ -0,0 +1,122 @@
+//
+// Low overhead per-stage timers and counters, compiled out unless MONITOR_INSTRUMENTATION is defined.
+//
+
+#include "instrumentation.h"
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+namespace data_monitor {
+namespace instrumentation {
+
+namespace {
+
+    std::array<ThreadSlot, MAX_THREAD_SLOTS> slots;
+    // Threads past MAX_THREAD_SLOTS all record here, with atomic adds
+    ThreadSlot overflow_slot{true};
+    // Guards retired and baseline, only taken at thread exit and by readers
+    std::mutex totals_mutex;
+    // Everything recorded by threads that have exited
+    Totals retired;
+    // Snapshot at the last Reset, subtracted from every later one
+    Totals baseline;
+
+    template <typename T, size_t N>
+    void SubtractArray(std::array<T, N> &values, const std::array<T, N> &other) {
+        for (size_t i = 0; i < N; i++) values[i] -= other[i];
+    }
+
+    void ClearSlot(ThreadSlot &slot) {
+        for (auto &value : slot.counters) value.store(0, std::memory_order_relaxed);
+        for (size_t s = 0; s < NUM_STAGES; s++) {
+            slot.stage_count[s].store(0, std::memory_order_relaxed);
+            slot.stage_ns[s].store(0, std::memory_order_relaxed);
+            for (auto &bucket : slot.buckets[s]) bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    Totals Sum() {
+        Totals totals = retired;
+        for (const auto &slot : slots) {
+            if (slot.in_use.load(std::memory_order_acquire)) totals.Add(slot);
+        }
+        totals.Add(overflow_slot);
+        return totals;
+    }
+
+    void PushSplit(uint64_t value, std::vector<uint32_t> &out) {
+        out.push_back(static_cast<uint32_t>(value));
+        out.push_back(static_cast<uint32_t>(value >> 32));
+    }
+
+} // namespace
+
+    void Totals::Add(const ThreadSlot &slot) {
+        for (size_t i = 0; i < NUM_COUNTERS; i++) counters[i] += slot.counters[i].load(std::memory_order_relaxed);
+        for (size_t s = 0; s < NUM_STAGES; s++) {
+            stage_count[s] += slot.stage_count[s].load(std::memory_order_relaxed);
+            stage_ns[s] += slot.stage_ns[s].load(std::memory_order_relaxed);
+            for (size_t b = 0; b < HIST_BUCKETS; b++) buckets[s][b] += slot.buckets[s][b].load(std::memory_order_relaxed);
+        }
+    }
+
+    void Totals::Subtract(const Totals &other) {
+        SubtractArray(counters, other.counters);
+        SubtractArray(stage_count, other.stage_count);
+        SubtractArray(stage_ns, other.stage_ns);
+        for (size_t s = 0; s < NUM_STAGES; s++) SubtractArray(buckets[s], other.buckets[s]);
+    }
+
+    ThreadSlot* ClaimSlot() {
+        // No allocation here, the allocation counter records through this on the first new of a thread
+        for (auto &slot : slots) {
+            bool expected = false;
+            if (!slot.in_use.load(std::memory_order_relaxed) &&
+                slot.in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                return &slot;
+            }
+        }
+        return &overflow_slot;
+    }
+
+    ThreadSlot* ReleaseSlot(ThreadSlot *slot) {
+        if (slot == &overflow_slot) return &overflow_slot;
+        // Fold the slot into the retired totals before the next thread can claim it
+        std::lock_guard<std::mutex> lock(totals_mutex);
+        retired.Add(*slot);
+        ClearSlot(*slot);
+        slot->in_use.store(false, std::memory_order_release);
+        return &overflow_slot;
+    }
+
+    Totals Snapshot() {
+        std::lock_guard<std::mutex> lock(totals_mutex);
+        Totals totals = Sum();
+        totals.Subtract(baseline);
+        return totals;
+    }
+
+    void Reset() {
+        std::lock_guard<std::mutex> lock(totals_mutex);
+        baseline = Sum();
+    }
+
+    void Serialize(const Totals &totals, std::vector<uint32_t> &out) {
+        out.reserve(out.size() + 4 + 2 * NUM_COUNTERS + NUM_STAGES * (4 + HIST_BUCKETS));
+        out.push_back(static_cast<uint32_t>(Enabled()) << 31 | METRIC_VERSION);
+        out.push_back(NUM_COUNTERS);
+        out.push_back(NUM_STAGES);
+        out.push_back(HIST_BUCKETS);
+        for (auto value : totals.counters) PushSplit(value, out);
+        for (size_t s = 0; s < NUM_STAGES; s++) {
+            PushSplit(totals.stage_count[s], out);
+            PushSplit(totals.stage_ns[s], out);
+            for (auto bucket : totals.buckets[s]) {
+                out.push_back(static_cast<uint32_t>(std::min<uint64_t>(bucket, std::numeric_limits<uint32_t>::max())));
+            }
+        }
+    }
+
+} // instrumentation
+} // data_monitor
@@ -0,0 +1,179 @@
+//
+// Low overhead per-stage timers and counters, compiled out unless MONITOR_INSTRUMENTATION is defined.
+//
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Each thread writes only its own slot, so recording is a plain load and store with no
+ * locked instructions or shared cache lines. Slots are claimed from a fixed table the first
+ * time a thread records anything and folded into a retired total when the thread exits, so
+ * the per-query decode threads don't use them up. Readers sum every slot.
+ *
+ * Stage durations go into log2 histograms of nanoseconds, bucket b holds [2^(b-1), 2^b) ns.
+ */
+
+namespace data_monitor {
+namespace instrumentation {
+
+    enum class Stage : uint8_t {
+        kOpenFile,      // decoder open and file mapping
+        kIndexFile,     // event index load or build
+        kDecode,        // ProcessEvents::GetEvent
+        kEventCopy,     // GetEventStruct into the flat event
+        kSummaryAlgs,   // minimal summary pipeline, one event
+        kChargeAlgs,    // single event charge waveforms and hits
+        kLightAlgs,     // single event light pulses
+        kSerialize,     // finishing a query's metrics, serializing and sending them
+        kSendMetric,    // one metric onto the status link, including pacing
+        kNumStages
+    };
+
+    enum class Counter : uint8_t {
+        kEventsDecoded,
+        kEventsSkipped,  // stepped over by the stride
+        kBytesRead,      // size of the decoded events
+        kAllocations,    // operator new calls, counted by the DataMonitor executable
+        kMetricsSent,
+        kBytesSent,
+        kDecoderReopens, // live decoder rebuilt after stopping at the end of the growing file
+        kNumCounters
+    };
+
+    constexpr static size_t NUM_STAGES = static_cast<size_t>(Stage::kNumStages);
+    constexpr static size_t NUM_COUNTERS = static_cast<size_t>(Counter::kNumCounters);
+    constexpr static size_t HIST_BUCKETS = 32;  // up to ~2 s, longer lands in the last bucket
+    // Threads recording at once, more than this share one overflow slot
+    constexpr static size_t MAX_THREAD_SLOTS = 32;
+
+    struct alignas(64) ThreadSlot {
+        std::atomic<bool> in_use{false};
+        std::atomic<uint64_t> counters[NUM_COUNTERS]{};
+        std::atomic<uint64_t> stage_count[NUM_STAGES]{};
+        std::atomic<uint64_t> stage_ns[NUM_STAGES]{};
+        std::atomic<uint64_t> buckets[NUM_STAGES][HIST_BUCKETS]{};
+        // The overflow slot has several writers and needs atomic adds
+        const bool shared;
+
+        constexpr explicit ThreadSlot(bool shared_slot = false) : shared(shared_slot) {}
+
+        void Add(std::atomic<uint64_t> &value, uint64_t n) {
+            if (shared) value.fetch_add(n, std::memory_order_relaxed);
+            else value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+    };
+
+    // Plain copy of everything recorded, summed over all threads
+    struct Totals {
+        std::array<uint64_t, NUM_COUNTERS> counters{};
+        std::array<uint64_t, NUM_STAGES> stage_count{};
+        std::array<uint64_t, NUM_STAGES> stage_ns{};
+        std::array<std::array<uint64_t, HIST_BUCKETS>, NUM_STAGES> buckets{};
+
+        void Add(const ThreadSlot &slot);
+        void Subtract(const Totals &other);
+    };
+
+    // Whether the hot path macros were compiled in
+    constexpr bool Enabled() {
+#ifdef MONITOR_INSTRUMENTATION
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    ThreadSlot* ClaimSlot();
+    // Returns the overflow slot, for anything the exiting thread still records after this
+    ThreadSlot* ReleaseSlot(ThreadSlot *slot);
+
+    // This thread's slot, claimed on first use and released when the thread exits
+    inline ThreadSlot& LocalSlot() {
+        struct Handle {
+            ThreadSlot *slot = ClaimSlot();
+            ~Handle() { slot = ReleaseSlot(slot); }
+        };
+        thread_local Handle handle;
+        return *handle.slot;
+    }
+
+    inline size_t Bucket(uint64_t ns) {
+        size_t bucket = ns == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(ns));
+        return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+    }
+
+    inline void Count(Counter counter, uint64_t n) {
+        ThreadSlot &slot = LocalSlot();
+        slot.Add(slot.counters[static_cast<size_t>(counter)], n);
+    }
+
+    inline void Record(Stage stage, uint64_t ns) {
+        ThreadSlot &slot = LocalSlot();
+        const auto s = static_cast<size_t>(stage);
+        slot.Add(slot.stage_count[s], 1);
+        slot.Add(slot.stage_ns[s], ns);
+        slot.Add(slot.buckets[s][Bucket(ns)], 1);
+    }
+
+    // Records the time from construction to the end of the scope
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Stage stage) : stage_(stage), start_(Clock::now()) {}
+        ~ScopedTimer() {
+            Record(stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count());
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        Stage stage_;
+        Clock::time_point start_;
+    };
+
+    // Everything recorded since the last Reset
+    Totals Snapshot();
+    // Later snapshots start from zero, the slots themselves are never written by the reader
+    void Reset();
+
+    /**
+    *  Self-monitoring metric, all 32b words:
+    *   [0]  enabled << 31 | version
+    *   [1..3]  NUM_COUNTERS, NUM_STAGES, HIST_BUCKETS
+    *   then each counter as two words, low then high
+    *   then for each stage: count (2 words), total ns (2 words), HIST_BUCKETS bucket counts
+    *   saturated to 32b
+    *
+    *   @param [in] totals:  From Snapshot
+    *   @param [out] out:  Appended to
+    */
+    void Serialize(const Totals &totals, std::vector<uint32_t> &out);
+
+    constexpr static uint32_t METRIC_VERSION = 1;
+    constexpr static uint32_t INSTRUMENTATION_METRIC = 0x400F;
+
+} // instrumentation
+} // data_monitor
+
+#define MONITOR_INSTR_CONCAT_(a, b) a##b
+#define MONITOR_INSTR_CONCAT(a, b) MONITOR_INSTR_CONCAT_(a, b)
+
+#ifdef MONITOR_INSTRUMENTATION
+// Time the rest of the enclosing scope as the given Stage
+#define MONITOR_TIME_SCOPE(stage) \
+    data_monitor::instrumentation::ScopedTimer MONITOR_INSTR_CONCAT(scoped_timer_, __LINE__)(data_monitor::instrumentation::Stage::stage)
+#define MONITOR_COUNT(counter, n) data_monitor::instrumentation::Count(data_monitor::instrumentation::Counter::counter, (n))
+#else
+#define MONITOR_TIME_SCOPE(stage) do {} while (0)
+#define MONITOR_COUNT(counter, n) do {} while (0)
+#endif
+
+#endif //INSTRUMENTATION_H
@@ -0,0 +1,247 @@
+//
+// Live tail mode, follows the file the readout is writing and pushes rolling summaries.
+//
+
+#include "live_monitor.h"
+#include "instrumentation.h"
+#include "logger.h"
+#include <algorithm>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace data_monitor {
+
+    LiveMonitor::LiveMonitor(MonitorQuery::MetricSender send_metric) : send_metric_(std::move(send_metric)) {
+        // Events arrive in order here so the running baselines can follow them
+        pipeline_.Get<ChargeSummaryAlg>().SetRunningStats(&charge_stats_);
+        pipeline_.Get<LightSummaryAlg>().SetRunningStats(&light_stats_);
+    }
+
+    LiveMonitor::~LiveMonitor() {
+        Stop();
+    }
+
+    void LiveMonitor::Start(const LiveOptions &options) {
+        Stop();
+        options_ = options;
+        if (options_.window_events > MAX_WINDOW_EVENTS) {
+            LOG_WARNING("Live window of {} events is over the maximum, using {}", options_.window_events, MAX_WINDOW_EVENTS);
+            options_.window_events = MAX_WINDOW_EVENTS;
+        }
+        options_.window_events = std::max<size_t>(options_.window_events, 1);
+        options_.push_interval_ms = std::max<uint32_t>(options_.push_interval_ms, 100);
+        pipeline_.Get<AdcHistogramAlg>().SetFormat(options_.histogram_format);
+        window_.assign(options_.window_events, EventPartial());
+        window_head_ = 0;
+        window_count_ = 0;
+        MinimalPipeline::Clear(window_sum_);
+        charge_stats_.Clear();
+        light_stats_.Clear();
+        events_processed_.store(0);
+        running_.store(true);
+        thread_ = std::thread([this]() { Loop(); });
+    }
+
+    void LiveMonitor::Stop() {
+        running_.store(false);
+        if (thread_.joinable()) thread_.join();
+        tail_.Close();
+        decoder_.reset();
+    }
+
+    bool LiveMonitor::FindNewestFile(uint32_t &file_number) const {
+        DIR *dir = opendir(MonitorQuery::DATA_DIR);
+        if (dir == nullptr) return false;
+        bool found = false;
+        while (struct dirent *entry = readdir(dir)) {
+            uint32_t run = 0, file = 0;
+            if (!MonitorQuery::ParseDataFileName(entry->d_name, run, file)) continue;
+            if (run != options_.run_number) continue;
+            if (!found || file > file_number) file_number = file;
+            found = true;
+        }
+        closedir(dir);
+        return found;
+    }
+
+    bool LiveMonitor::OpenFile(uint32_t file_number) {
+        std::string data_file = MonitorQuery::DataFileName(options_.run_number, file_number);
+        events_decoded_ = 0;
+        decoder_reopens_ = 0;
+        decoder_stalled_ = false;
+        if (!tail_.Open(data_file) || !ReopenDecoder()) {
+            LOG_ERROR("Live: failed to open {}", data_file);
+            tail_.Close();
+            decoder_.reset();
+            return false;
+        }
+        file_number_ = file_number;
+        LOG_INFO("Live: following {}", data_file);
+        return true;
+    }
+
+    void LiveMonitor::DecodeCompleteEvents() {
+        if (decoder_ == nullptr || decoder_stalled_) return;
+        tail_.Poll();
+        bool reopened = false;
+        while (events_decoded_ < tail_.NumComplete() && running_.load()) {
+            bool decoded = false;
+            {
+                MONITOR_TIME_SCOPE(kDecode);
+                decoded = decoder_->GetEvent();
+            }
+            if (!decoded) {
+                // The decoder may have stopped at what was the end of the file, reopen it once
+                // and walk the headers back to where it was
+                if (!reopened && decoder_reopens_ < MAX_DECODER_REOPENS) {
+                    reopened = true;
+                    decoder_reopens_++;
+                    MONITOR_COUNT(kDecoderReopens, 1);
+                    if (ReopenDecoder()) continue;
+                }
+                if (decoder_reopens_ >= MAX_DECODER_REOPENS) {
+                    LOG_WARNING("Live: decoder stopped {} times on {}, waiting for the next file", decoder_reopens_, tail_.Path());
+                    decoder_stalled_ = true;
+                } else {
+                    LOG_ERROR("Live: decoder stopped at event {}", events_decoded_);
+                }
+                break;
+            }
+            {
+                MONITOR_TIME_SCOPE(kEventCopy);
+                flat_event_.Fill(decoder_->GetEventStruct());
+            }
+            MONITOR_COUNT(kEventsDecoded, 1);
+            AddToWindow(flat_event_);
+            events_decoded_++;
+            events_processed_++;
+        }
+    }
+
+    bool LiveMonitor::ReopenDecoder() {
+        decoder_ = std::make_unique<ProcessEvents>(light_slot_, false, std::vector<uint16_t>(), false);
+        decoder_->UseEventStride(true);
+        decoder_->SetEventStride(1);
+        if (!decoder_->OpenFile(tail_.Path())) return false;
+        for (size_t evt = 0; evt < events_decoded_; evt++) {
+            if (!decoder_->GetEvent()) return false;
+            MONITOR_COUNT(kEventsSkipped, 1);
+        }
+        return true;
+    }
+
+    void LiveMonitor::AddToWindow(const FlatEvent &event) {
+        MONITOR_TIME_SCOPE(kSummaryAlgs);
+        EventPartial &slot = window_[window_head_];
+        if (window_count_ == window_.size()) {
+            // The window is full, the oldest event leaves it
+            MinimalPipeline::Subtract(window_sum_, slot);
+        } else {
+            window_count_++;
+        }
+        MinimalPipeline::Clear(slot);
+        pipeline_.ProcessEvent(event, slot);
+        MinimalPipeline::Merge(window_sum_, slot);
+        window_head_ = (window_head_ + 1) % window_.size();
+    }
+
+    void LiveMonitor::PushMetrics() {
+        if (window_count_ == 0) return;
+        lbw_metrics_.setRunNumber(options_.run_number);
+        lbw_metrics_.setFileNumber(file_number_);
+        lbw_metrics_.setEvtNumber(events_decoded_);
+        pipeline_.UpdateMetrics(window_sum_, lbw_metrics_, metrics_);
+        if (options_.debug) lbw_metrics_.print();
+
+        auto tmp_vec = lbw_metrics_.serialize();
+        send_metric_(tmp_vec, LIVE_LBW_METRIC);
+        alg_metrics_.clear();
+        pipeline_.SerializeMetrics(window_sum_, {options_.run_number, file_number_, static_cast<uint32_t>(events_decoded_)}, alg_metrics_);
+        for (auto &alg_metric : alg_metrics_) send_metric_(alg_metric.payload, alg_metric.metric_id);
+        PushRunningBaseline();
+    }
+
+    void LiveMonitor::PushRunningBaseline() {
+        std::vector<uint32_t> metric_vec;
+        metric_vec.reserve(3 + 2 * NUM_CHARGE_CHANNELS + 2 * NUM_LIGHT_CHANNELS);
+        metric_vec.push_back(options_.run_number);
+        metric_vec.push_back(file_number_);
+        metric_vec.push_back(static_cast<uint32_t>(events_decoded_));
+        // Same integer scaling as the LBW metric
+        for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) metric_vec.push_back(static_cast<uint32_t>(charge_stats_.EwmaMean(ch)));
+        for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) metric_vec.push_back(static_cast<uint32_t>(15 * charge_stats_.EwmaRms(ch)));
+        for (size_t ch = 0; ch < NUM_LIGHT_CHANNELS; ch++) metric_vec.push_back(static_cast<uint32_t>(light_stats_.EwmaMean(ch)));
+        for (size_t ch = 0; ch < NUM_LIGHT_CHANNELS; ch++) metric_vec.push_back(static_cast<uint32_t>(15 * light_stats_.EwmaRms(ch)));
+        send_metric_(metric_vec, LIVE_BASELINE_METRIC);
+    }
+
+    void LiveMonitor::Loop() {
+        // Directory events tell us when the file grows or the next file is created. Without
+        // inotify the same checks just run every MAX_POLL_MS.
+        int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        int watch = -1;
+        if (inotify_fd >= 0) {
+            watch = inotify_add_watch(inotify_fd, MonitorQuery::DATA_DIR, IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE);
+        }
+        if (watch < 0) LOG_WARNING("Live: inotify unavailable, polling {}", MonitorQuery::DATA_DIR);
+
+        uint32_t newest_file = 0;
+        if (FindNewestFile(newest_file)) OpenFile(newest_file);
+
+        const auto push_interval = std::chrono::milliseconds(options_.push_interval_ms);
+        auto next_push = Clock::now() + push_interval;
+        alignas(struct inotify_event) char event_buffer[4096];
+        while (running_.load()) {
+            auto until_push = std::chrono::duration_cast<std::chrono::milliseconds>(next_push - Clock::now()).count();
+            int timeout_ms = static_cast<int>(std::clamp<int64_t>(until_push, 0, MAX_POLL_MS));
+
+            bool new_file = false;
+            if (watch >= 0) {
+                pollfd pfd{inotify_fd, POLLIN, 0};
+                if (poll(&pfd, 1, timeout_ms) > 0) {
+                    ssize_t len;
+                    while ((len = read(inotify_fd, event_buffer, sizeof(event_buffer))) > 0) {
+                        for (char *ptr = event_buffer; ptr < event_buffer + len;) {
+                            auto *event = reinterpret_cast<struct inotify_event*>(ptr);
+                            uint32_t run = 0, file = 0;
+                            if (event->len > 0 && (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                                MonitorQuery::ParseDataFileName(event->name, run, file) &&
+                                run == options_.run_number && (decoder_ == nullptr || file > file_number_)) {
+                                newest_file = std::max(newest_file, file);
+                                new_file = true;
+                            }
+                            ptr += sizeof(struct inotify_event) + event->len;
+                        }
+                    }
+                }
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+                uint32_t file = 0;
+                if (FindNewestFile(file) && (decoder_ == nullptr || file > file_number_)) {
+                    newest_file = file;
+                    new_file = true;
+                }
+            }
+
+            // Nothing followed yet, e.g. the run hadn't started writing or the open failed
+            if (decoder_ == nullptr && !new_file) new_file = FindNewestFile(newest_file);
+
+            // Finish what was written to the old file before following the new one
+            DecodeCompleteEvents();
+            if (new_file && OpenFile(newest_file)) DecodeCompleteEvents();
+
+            if (Clock::now() >= next_push) {
+                PushMetrics();
+                next_push += push_interval;
+                // Don't try to catch up on pushes missed while decoding a backlog
+                if (next_push < Clock::now()) next_push = Clock::now() + push_interval;
+            }
+        }
+
+        if (watch >= 0) inotify_rm_watch(inotify_fd, watch);
+        if (inotify_fd >= 0) close(inotify_fd);
+    }
+
+} // data_monitor
@@ -0,0 +1,114 @@
+//
+// Live tail mode, follows the file the readout is writing and pushes rolling summaries.
+//
+
+#ifndef LIVE_MONITOR_H
+#define LIVE_MONITOR_H
+
+#include "monitor_query.h"
+#include "summary_store.h"
+#include "tail_reader.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace data_monitor {
+
+    struct LiveOptions {
+        uint32_t run_number = 0;
+        // Events in the rolling window the metrics are made from, 1 to LiveMonitor::MAX_WINDOW_EVENTS
+        size_t window_events = 100;
+        uint32_t push_interval_ms = 5000;
+        HistogramFormat histogram_format = HistogramFormat::kSparse;
+        bool debug = false;
+    };
+
+class LiveMonitor {
+public:
+    explicit LiveMonitor(MonitorQuery::MetricSender send_metric);
+    ~LiveMonitor();
+
+    LiveMonitor(const LiveMonitor&) = delete;
+    LiveMonitor& operator=(const LiveMonitor&) = delete;
+
+    // The window keeps every event's full partial, ~35 KB each, so the size from the command is capped
+    constexpr static size_t MAX_WINDOW_EVENTS = 1000;
+
+    /**
+    *  Start following the newest file of a run, restarting if already running.
+    *  When the readout moves on to the next file the monitor follows it.
+    */
+    void Start(const LiveOptions &options);
+    void Stop();
+
+    bool IsRunning() const { return running_.load(); }
+    size_t EventsProcessed() const { return events_processed_.load(); }
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    void Loop();
+    // Newest file of the run in the data directory, false if there is none yet
+    bool FindNewestFile(uint32_t &file_number) const;
+    bool OpenFile(uint32_t file_number);
+    // New decoder on the followed file, positioned after the events already decoded. The decoder
+    // can't seek so this walks every decoded event again, the reopens per file are capped.
+    bool ReopenDecoder();
+    // Decode every event that has been completely written since the last call
+    void DecodeCompleteEvents();
+    void AddToWindow(const FlatEvent &event);
+    void PushMetrics();
+    // EWMA baseline & RMS per channel, follows drifts faster than the window summary
+    void PushRunningBaseline();
+
+    MonitorQuery::MetricSender send_metric_;
+    LiveOptions options_;
+    std::thread thread_;
+    std::atomic_bool running_{false};
+    std::atomic<size_t> events_processed_{0};
+
+    // The decoder stays open on the growing file and is only asked for an event
+    // once the tail reader has seen all of it on disk
+    std::unique_ptr<ProcessEvents> decoder_;
+    TailReader tail_;
+    uint32_t file_number_ = 0;
+    size_t events_decoded_ = 0;
+    size_t decoder_reopens_ = 0;
+    // Out of reopens, the rest of the file is skipped until the readout starts the next one
+    bool decoder_stalled_ = false;
+    FlatEvent flat_event_;
+
+    // Ring of the last window_events partials, the window sums add the newest
+    // and subtract the oldest so each push costs the same however big the window
+    std::vector<EventPartial> window_;
+    size_t window_head_ = 0;
+    size_t window_count_ = 0;
+    EventPartial window_sum_;
+    ChargeStats charge_stats_;
+    LightStats light_stats_;
+
+    MinimalPipeline pipeline_;
+    std::vector<AlgMetric> alg_metrics_;
+    LowBwTpcMonitor lbw_metrics_;
+    TpcMonitor metrics_;
+
+    constexpr static uint16_t light_slot_ = 16;
+    // Longest wait between checks, bounds how long Stop() and the inotify fallback take
+    constexpr static int MAX_POLL_MS = 500;
+    // Each reopen costs a walk over the whole file so far, this bounds the walks to a few file lengths
+    constexpr static size_t MAX_DECODER_REOPENS = 8;
+
+};
+
+    // Rolling window summary, same payload as LBW_METRIC with the last decoded event number
+    constexpr static uint32_t LIVE_LBW_METRIC = 0x4008;
+    // run, file, event, then charge baselines, 15 x charge RMS, light baselines, 15 x light RMS
+    constexpr static uint32_t LIVE_BASELINE_METRIC = 0x4009;
+
+} // data_monitor
+
+#endif //LIVE_MONITOR_H
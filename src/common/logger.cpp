@@ -0,0 +1,160 @@
+//
+// Asynchronous logger, the calling thread only copies the arguments and a background thread formats them.
+//
+
+#include "logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+
+namespace data_monitor {
+
+    void LogRecord::AddString(const char *str, size_t length) {
+        if (num_args == MAX_ARGS) return;
+        length = std::min(length, TEXT_BYTES - text_used);
+        LogArg &arg = args[num_args++];
+        arg.type = LogArg::kString;
+        arg.str_offset = text_used;
+        arg.str_length = static_cast<uint16_t>(length);
+        if (length > 0) std::memcpy(text + text_used, str, length);
+        text_used += static_cast<uint16_t>(length);
+    }
+
+    Logger& Logger::Instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger::Logger() : writer_([this]() { WriterLoop(); }) {}
+
+    Logger::~Logger() {
+        running_.store(false);
+        flush_cv_.notify_all();
+        if (writer_.joinable()) writer_.join();
+    }
+
+    uint64_t Logger::NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Logger::Ring& Logger::LocalRing() {
+        thread_local Ring *ring = nullptr;
+        if (ring == nullptr) ring = &RegisterRing();
+        return *ring;
+    }
+
+    Logger::Ring& Logger::RegisterRing() {
+        // Keeps the ring alive for this thread, the writer drops it once it is orphaned and empty
+        thread_local std::shared_ptr<Ring> owner;
+        owner = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        rings_.push_back(owner);
+        return *owner;
+    }
+
+    void Logger::Flush() {
+        size_t ticket = flush_requests_.fetch_add(1) + 1;
+        flush_cv_.notify_all();
+        std::unique_lock<std::mutex> lock(flush_mutex_);
+        flush_cv_.wait(lock, [&]() { return flushes_done_.load() >= ticket || !running_.load(); });
+    }
+
+    std::string Logger::Format(const LogRecord &record) {
+        std::string line;
+        line.reserve(128);
+        char number[32];
+        size_t next_arg = 0;
+        for (const char *ptr = record.format; *ptr != '\0'; ptr++) {
+            bool plain = ptr[0] == '{' && ptr[1] == '}';
+            bool hex = ptr[0] == '{' && std::strncmp(ptr, "{:x}", 4) == 0;
+            if ((!plain && !hex) || next_arg == record.num_args) {
+                line.push_back(*ptr);
+                continue;
+            }
+            const LogArg &arg = record.args[next_arg++];
+            switch (arg.type) {
+                case LogArg::kInt:
+                    std::snprintf(number, sizeof(number), hex ? "%" PRIx64 : "%" PRId64, arg.i);
+                    line += number;
+                    break;
+                case LogArg::kUint:
+                    std::snprintf(number, sizeof(number), hex ? "%" PRIx64 : "%" PRIu64, arg.u);
+                    line += number;
+                    break;
+                case LogArg::kDouble:
+                    std::snprintf(number, sizeof(number), "%g", arg.d);
+                    line += number;
+                    break;
+                case LogArg::kString:
+                    line.append(record.text + arg.str_offset, arg.str_length);
+                    break;
+            }
+            ptr += hex ? 3 : 1;
+        }
+        return line;
+    }
+
+    size_t Logger::WriteBatch() {
+        batch_.clear();
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            for (auto &ring : rings_) {
+                LogRecord record;
+                while (ring->Pop(record)) batch_.push_back(record);
+            }
+            // Threads that exited and left nothing behind
+            rings_.erase(std::remove_if(rings_.begin(), rings_.end(), [](const std::shared_ptr<Ring> &ring) {
+                return ring.use_count() == 1 && ring->Empty();
+            }), rings_.end());
+        }
+        // Each ring is in order, interleave the threads by time
+        std::stable_sort(batch_.begin(), batch_.end(), [](const LogRecord &a, const LogRecord &b) {
+            return a.time_ns < b.time_ns;
+        });
+
+        bool wrote_out = false, wrote_err = false;
+        for (const auto &record : batch_) {
+            std::ostream &stream = record.level >= LogLevel::kWarning ? std::cerr : std::cout;
+            stream << Format(record) << '\n';
+            wrote_out |= &stream == &std::cout;
+            wrote_err |= &stream == &std::cerr;
+        }
+        size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            std::cerr << "Logger: dropped " << dropped << " records\n";
+            wrote_err = true;
+        }
+        // One flush per batch instead of per line
+        if (wrote_out) std::cout.flush();
+        if (wrote_err) std::cerr.flush();
+        return batch_.size();
+    }
+
+    void Logger::WriterLoop() {
+        while (true) {
+            size_t requested = flush_requests_.load();
+            size_t written = WriteBatch();
+            if (requested > flushes_done_.load()) {
+                {
+                    std::lock_guard<std::mutex> lock(flush_mutex_);
+                    flushes_done_.store(requested);
+                }
+                flush_cv_.notify_all();
+            }
+            if (!running_.load()) {
+                // Anything logged during shutdown
+                WriteBatch();
+                return;
+            }
+            if (written > 0) continue;
+            std::unique_lock<std::mutex> lock(flush_mutex_);
+            flush_cv_.wait_for(lock, std::chrono::microseconds(IDLE_SLEEP_US), [&]() {
+                return flush_requests_.load() > flushes_done_.load() || !running_.load();
+            });
+        }
+    }
+
+} // data_monitor
@@ -0,0 +1,195 @@
+//
+// Asynchronous logger, the calling thread only copies the arguments and a background thread formats them.
+//
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "spsc_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+ * LOG_DEBUG("Processing event {}", evt) costs a clock read and a copy of the arguments into
+ * this thread's ring buffer, no formatting, locks or I/O. The writer thread drains every ring,
+ * orders the records by time, formats them and flushes once per batch. A full ring drops the
+ * record instead of blocking, the drops are reported by the writer.
+ *
+ * The format must be a string literal, only its pointer is kept. "{}" is replaced by the next
+ * argument, "{:x}" prints an integer in hex. Levels below MONITOR_LOG_LEVEL are compiled out.
+ */
+
+// 0 debug, 1 info, 2 warning, 3 error
+#ifndef MONITOR_LOG_LEVEL
+#define MONITOR_LOG_LEVEL 0
+#endif
+
+namespace data_monitor {
+
+    enum class LogLevel : uint8_t {
+        kDebug = 0,
+        kInfo = 1,
+        kWarning = 2,
+        kError = 3
+    };
+
+    // One argument, strings are copied into the record's text buffer
+    struct LogArg {
+        enum Type : uint8_t { kInt, kUint, kDouble, kString };
+        Type type;
+        uint16_t str_offset;
+        uint16_t str_length;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+        };
+    };
+
+    struct LogRecord {
+        constexpr static size_t MAX_ARGS = 8;
+        constexpr static size_t TEXT_BYTES = 160;
+
+        uint64_t time_ns;
+        const char *format;
+        LogLevel level;
+        uint8_t num_args;
+        uint16_t text_used;
+        LogArg args[MAX_ARGS];
+        char text[TEXT_BYTES];
+
+        // Strings longer than what is left of the text buffer are truncated
+        void AddString(const char *str, size_t length);
+
+        template <typename T>
+        void Add(const T &value) {
+            if (num_args == MAX_ARGS) return;
+            using V = std::decay_t<T>;
+            LogArg &arg = args[num_args];
+            if constexpr (std::is_same_v<V, bool>) {
+                arg.type = LogArg::kUint;
+                arg.u = value;
+            } else if constexpr (std::is_enum_v<V>) {
+                arg.type = LogArg::kInt;
+                arg.i = static_cast<int64_t>(value);
+            } else if constexpr (std::is_integral_v<V> && std::is_signed_v<V>) {
+                arg.type = LogArg::kInt;
+                arg.i = value;
+            } else if constexpr (std::is_integral_v<V>) {
+                arg.type = LogArg::kUint;
+                arg.u = value;
+            } else if constexpr (std::is_floating_point_v<V>) {
+                arg.type = LogArg::kDouble;
+                arg.d = value;
+            } else if constexpr (std::is_same_v<V, std::string>) {
+                AddString(value.data(), value.size());
+                return;
+            } else {
+                static_assert(std::is_convertible_v<V, const char*>, "Unsupported log argument type");
+                const char *str = value;
+                AddString(str, str == nullptr ? 0 : std::strlen(str));
+                return;
+            }
+            num_args++;
+        }
+    };
+
+class Logger {
+public:
+
+    // Rough per-thread record count, past it records are dropped until the writer catches up
+    constexpr static size_t RING_CAPACITY = 256;
+    using Ring = SpscQueue<LogRecord, RING_CAPACITY>;
+
+    static Logger& Instance();
+
+    template <typename... Args>
+    void Log(LogLevel level, const char *format, const Args&... args) {
+        LogRecord record;
+        record.time_ns = NowNs();
+        record.format = format;
+        record.level = level;
+        record.num_args = 0;
+        record.text_used = 0;
+        (record.Add(args), ...);
+        if (!LocalRing().Push(record)) dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Block until everything this thread logged before the call has been written
+    void Flush();
+
+    // Format a record the way the writer does, for tests and tools
+    static std::string Format(const LogRecord &record);
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+private:
+
+    Logger();
+    ~Logger();
+
+    static uint64_t NowNs();
+
+    // This thread's ring, registered with the writer on first use. The writer shares ownership
+    // so records left by an exiting thread are still written.
+    Ring& LocalRing();
+    Ring& RegisterRing();
+
+    void WriterLoop();
+    // Drain every ring and write the records in time order, returns the number written
+    size_t WriteBatch();
+
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::vector<LogRecord> batch_;
+
+    std::atomic<size_t> dropped_{0};
+    std::atomic<size_t> flush_requests_{0};
+    std::atomic<size_t> flushes_done_{0};
+    std::mutex flush_mutex_;
+    std::condition_variable flush_cv_;
+
+    std::atomic_bool running_{true};
+    // Idle wait between drains, producers never wake the writer
+    constexpr static uint32_t IDLE_SLEEP_US = 2000;
+    std::thread writer_;
+
+};
+
+} // data_monitor
+
+#define MONITOR_LOG_(level, ...) \
+    data_monitor::Logger::Instance().Log(data_monitor::LogLevel::level, __VA_ARGS__)
+
+#if MONITOR_LOG_LEVEL <= 0
+#define LOG_DEBUG(...) MONITOR_LOG_(kDebug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+#if MONITOR_LOG_LEVEL <= 1
+#define LOG_INFO(...) MONITOR_LOG_(kInfo, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+#if MONITOR_LOG_LEVEL <= 2
+#define LOG_WARNING(...) MONITOR_LOG_(kWarning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) do {} while (0)
+#endif
+#if MONITOR_LOG_LEVEL <= 3
+#define LOG_ERROR(...) MONITOR_LOG_(kError, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#endif //LOGGER_H
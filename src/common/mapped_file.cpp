@@ -0,0 +1,67 @@
+//
+// Read-only memory mapped readout file.
+//
+
+#include "mapped_file.h"
+#include "logger.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace data_monitor {
+
+    MappedFile::~MappedFile() {
+        Close();
+    }
+
+    bool MappedFile::Open(const std::string &path) {
+        Close();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping holds its own reference to the file
+        close(fd);
+        if (data == MAP_FAILED) {
+            LOG_ERROR("Failed to mmap file: {}", path);
+            return false;
+        }
+
+        path_ = path;
+        data_ = data;
+        size_ = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void MappedFile::Close() {
+        if (data_ != nullptr) munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+        path_.clear();
+    }
+
+    WordSpan MappedFile::Words(uint64_t byte_offset, size_t num_bytes) const {
+        return Words().subspan(byte_offset / sizeof(uint32_t), num_bytes / sizeof(uint32_t));
+    }
+
+    void MappedFile::AdviseSequential() const {
+        if (data_ != nullptr) madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+
+    void MappedFile::AdviseWillNeed(uint64_t byte_offset, size_t num_bytes) const {
+        if (data_ == nullptr || byte_offset >= size_) return;
+        // madvise wants a page aligned address
+        const auto page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        uint64_t start = byte_offset - (byte_offset % page);
+        uint64_t len = std::min<uint64_t>(byte_offset + num_bytes, size_) - start;
+        madvise(static_cast<uint8_t*>(data_) + start, len, MADV_WILLNEED);
+    }
+
+} // data_monitor
@@ -0,0 +1,56 @@
+//
+// Read-only memory mapped readout file.
+//
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "sample_span.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace data_monitor {
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+    *  Map the whole file read-only. Any previously mapped file is unmapped first.
+    *
+    *   @param [in] path:  Path to the file to map
+    *
+    * @return  Returns true on success, false on failure.
+    */
+    bool Open(const std::string &path);
+    void Close();
+
+    bool IsOpen() const { return data_ != nullptr; }
+    const std::string& Path() const { return path_; }
+    size_t Size() const { return size_; }
+    const uint8_t* Data() const { return static_cast<const uint8_t*>(data_); }
+
+    // The readout is written as 32b words, a trailing partial word is not included
+    WordSpan Words() const { return {static_cast<const uint32_t*>(data_), size_ / sizeof(uint32_t)}; }
+    WordSpan Words(uint64_t byte_offset, size_t num_bytes) const;
+
+    // Access pattern hints for the kernel readahead
+    void AdviseSequential() const;
+    void AdviseWillNeed(uint64_t byte_offset, size_t num_bytes) const;
+
+private:
+
+    std::string path_;
+    void *data_ = nullptr;
+    size_t size_ = 0;
+
+};
+
+} // data_monitor
+
+#endif //MAPPED_FILE_H
@@ -0,0 +1,55 @@
+//
+// Framed multi-record message for sending many metrics in one command.
+//
+
+#include "metric_batch.h"
+
+namespace data_monitor {
+
+    MetricBatch::MetricBatch(size_t max_words) : max_words_(max_words) {
+        Clear();
+    }
+
+    void MetricBatch::Clear() {
+        words_.clear();
+        words_.push_back(BATCH_VERSION << 24);
+        num_records_ = 0;
+    }
+
+    bool MetricBatch::Add(uint32_t metric_id, const std::vector<uint32_t> &payload) {
+        size_t record_words = RECORD_HEADER_WORDS + payload.size();
+        if (!Empty() && words_.size() + record_words > max_words_) return false;
+        words_.push_back(metric_id);
+        words_.push_back(static_cast<uint32_t>(payload.size()));
+        words_.insert(words_.end(), payload.begin(), payload.end());
+        num_records_++;
+        words_[0] = (BATCH_VERSION << 24) | num_records_;
+        return true;
+    }
+
+    std::vector<uint32_t> MetricBatch::TakeWords() {
+        std::vector<uint32_t> words = std::move(words_);
+        words_ = std::vector<uint32_t>();
+        words_.reserve(max_words_);
+        Clear();
+        return words;
+    }
+
+    bool MetricBatch::Unpack(const std::vector<uint32_t> &words, std::vector<Record> &records) {
+        records.clear();
+        if (words.empty() || (words[0] >> 24) != BATCH_VERSION) return false;
+        uint32_t num_records = words[0] & 0xFFFFFF;
+        size_t pos = 1;
+        for (uint32_t i = 0; i < num_records; i++) {
+            if (pos + RECORD_HEADER_WORDS > words.size()) return false;
+            uint32_t metric_id = words[pos];
+            uint32_t num_words = words[pos + 1];
+            pos += RECORD_HEADER_WORDS;
+            if (pos + num_words > words.size()) return false;
+            records.push_back({metric_id, std::vector<uint32_t>(words.begin() + pos, words.begin() + pos + num_words)});
+            pos += num_words;
+        }
+        return pos == words.size();
+    }
+
+} // data_monitor
@@ -0,0 +1,66 @@
+//
+// Framed multi-record message for sending many metrics in one command.
+//
+
+#ifndef METRIC_BATCH_H
+#define METRIC_BATCH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace data_monitor {
+
+/*
+ * Batch layout, all 32b words:
+ *   [0]  version << 24 | number of records
+ *   then for each record
+ *   [0]  metric ID, e.g. 0x4002 charge event
+ *   [1]  N, number of payload words
+ *   [2..N+1] the serialized metric
+ */
+class MetricBatch {
+public:
+    struct Record {
+        uint32_t metric_id;
+        std::vector<uint32_t> payload;
+    };
+
+    explicit MetricBatch(size_t max_words);
+    ~MetricBatch() = default;
+
+    /**
+    *  Append a serialized metric to the batch. A metric bigger than the batch limit is
+    *  still accepted into an empty batch so it can always be sent.
+    *
+    * @return  Returns false if the batch is full, flush it and add again.
+    */
+    bool Add(uint32_t metric_id, const std::vector<uint32_t> &payload);
+
+    bool Empty() const { return num_records_ == 0; }
+    size_t NumRecords() const { return num_records_; }
+    size_t NumWords() const { return words_.size(); }
+    void SetMaxWords(size_t max_words) { max_words_ = max_words; }
+
+    // Move the framed message out and start a new batch
+    std::vector<uint32_t> TakeWords();
+    void Clear();
+
+    // Reference decoder for the ground side, returns false on a malformed batch
+    static bool Unpack(const std::vector<uint32_t> &words, std::vector<Record> &records);
+
+    constexpr static uint32_t BATCH_VERSION = 1;
+
+private:
+
+    constexpr static size_t RECORD_HEADER_WORDS = 2;
+
+    std::vector<uint32_t> words_;
+    size_t max_words_;
+    uint32_t num_records_ = 0;
+
+};
+
+} // data_monitor
+
+#endif //METRIC_BATCH_H
@@ -0,0 +1,833 @@
+//
+// One monitor query, owns everything needed to process a file so queries can run concurrently.
+//
+
+#include "monitor_query.h"
+#include "instrumentation.h"
+#include "logger.h"
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <future>
+#include <thread>
+
+namespace data_monitor {
+
+namespace {
+
+    // The decoder's next event, timed when instrumented
+    bool NextEvent(ProcessEvents &decoder) {
+        MONITOR_TIME_SCOPE(kDecode);
+        return decoder.GetEvent();
+    }
+
+} // namespace
+
+    MonitorQuery::MonitorQuery(QueryType type, const std::vector<uint32_t> &args, WorkerPool &worker_pool,
+                               MetricSender send_metric, const QueryOptions &options, ResultCache *result_cache,
+                               SummaryStore *summary_store, FilePrefetcher *next_file_prefetcher) :
+    type_(type),
+    options_(options),
+    worker_pool_(worker_pool),
+    send_metric_(std::move(send_metric)),
+    result_cache_(result_cache),
+    summary_store_(summary_store),
+    next_file_prefetcher_(next_file_prefetcher),
+    random_generator_(options.random_seed),
+    light_algs_(),
+    charge_algs_(),
+    metric_batch_(options.max_batch_words),
+    debug_(options.debug)
+    {
+        process_events_ = std::make_unique<ProcessEvents>(light_slot_, false, std::vector<uint16_t>(), false);
+        process_events_->UseEventStride(true);
+        for (auto &event : event_pool_) free_events_.Push(&event);
+
+        setFileName(args);
+        event_arg_ = args.at(2);
+        stride_arg_ = args.at(3);
+        if (type_ == QueryType::kMinimal) {
+            setNumEvent(args);
+            if (args.size() > 4 && (args.at(4) & MinimalPipeline::ALL_ALGS) != 0) {
+                alg_mask_ = args.at(4) & MinimalPipeline::ALL_ALGS;
+            }
+            pipeline_.Get<AdcHistogramAlg>().SetFormat(options_.histogram_format);
+            // Stored partials hold every algorithm so a subset query can still merge them
+            store_partials_ = summary_store_ != nullptr && alg_mask_ == MinimalPipeline::ALL_ALGS;
+        } else if (type_ == QueryType::kRunScan) {
+            last_file_number_ = args.at(2);
+            event_stride_ = std::max<uint32_t>(args.at(4), 1);
+            // Every event of each file unless asked for fewer
+            process_num_events_ = args.at(3) == 0 ? EVENT_LOOP_MAX : std::min<size_t>(args.at(3) * event_stride_, 5000);
+            per_file_metrics_ = args.size() > 5 && args.at(5) == 1;
+            pipeline_.Get<AdcHistogramAlg>().SetFormat(options_.histogram_format);
+            store_partials_ = summary_store_ != nullptr;
+        } else {
+            // We want to take one stride to the event we want, process it and quit.
+            setEventNumber(args);
+            choose_random_ = args.at(3) == 1;
+            if (choose_random_) {
+                // Pick the channel up front so the rest of the decoded charge event is never copied or searched
+                auto charge_uniform = std::uniform_int_distribution<size_t>(0, NUM_CHARGE_CHANNELS - 1);
+                random_charge_channel_ = charge_uniform(random_generator_);
+                channel_selection_.Clear();
+                channel_selection_.SelectCharge(random_charge_channel_);
+                // The ROI is picked among the event's cosmic ROIs, they are only known once it is decoded
+                channel_selection_.SelectAllLight();
+            }
+            // Only minimal summaries are made of mergeable partials
+            summary_store_ = nullptr;
+        }
+    }
+
+    void MonitorQuery::Run() {
+        ResultKey key;
+        bool cacheable = result_cache_ != nullptr && MakeResultKey(key);
+        if (cacheable) {
+            auto cached = result_cache_->Lookup(key);
+            if (cached) {
+                ReplayResult(*cached);
+                if (!IsCancelled()) PrefetchNextFile(file_number_);
+                return;
+            }
+            record_metrics_ = true;
+        }
+
+        // The summary accumulators merge exactly so the file can be split across the workers
+        if (type_ == QueryType::kMinimal) ProcessFileParallel();
+        else if (type_ == QueryType::kRunScan) ScanRun();
+        else ProcessFile();
+
+        // A cancelled query only sent part of its result, a failed one only its error
+        if (cacheable && !IsCancelled() && !failed_) result_cache_->Insert(key, std::move(sent_metrics_));
+        sent_metrics_.clear();
+        if (!IsCancelled()) PrefetchNextFile(type_ == QueryType::kRunScan ? scanned_last_file_ : file_number_);
+    }
+
+    void MonitorQuery::PrefetchNextFile(uint32_t last_file_number) {
+        if (next_file_prefetcher_ == nullptr) return;
+        // During a run the next file may not have been started yet
+        std::string next_file = DataFileName(run_number_, last_file_number + 1, DataDir());
+        if (access(next_file.c_str(), R_OK) != 0) return;
+        // Concurrent queries finishing on the same file only start it once
+        if (next_file_prefetcher_->IsRunning() && next_file_prefetcher_->Path() == next_file) return;
+        if (debug_) LOG_DEBUG("Prefetching {}", next_file);
+        next_file_prefetcher_->Start(next_file, 0, NEXT_FILE_PREFETCH_BYTES);
+    }
+
+    void MonitorQuery::PrefetchSelected() {
+        if (!event_index_.IsValid() || selected_events_.empty()) return;
+        const EventIndexEntry &first = event_index_.At(selected_events_.front());
+        const EventIndexEntry &last = event_index_.At(selected_events_.back());
+        const uint64_t span = last.offset + last.size - first.offset;
+        uint64_t selected_bytes = 0;
+        for (auto evt : selected_events_) selected_bytes += event_index_.At(evt).size;
+        // Streaming reads the gaps too, only worth it when the events are most of the span
+        if (selected_bytes * DENSE_SELECTION_FRACTION >= span &&
+            range_prefetcher_.Start(monitor_file_, first.offset, span, true)) {
+            return;
+        }
+        // Start the kernel reading the wanted events into the page cache ahead of the decoder
+        for (auto evt : selected_events_) {
+            mapped_file_.AdviseWillNeed(event_index_.At(evt).offset, event_index_.At(evt).size);
+        }
+    }
+
+    bool MonitorQuery::MakeResultKey(ResultKey &key) const {
+        // A random channel is meant to be different every time, and a run gains files as it is written
+        if (choose_random_ || type_ == QueryType::kRunScan) return false;
+        if (!EventIndex::FileStat(monitor_file_, key.file_size, key.file_mtime)) return false;
+        key.query_type = static_cast<uint32_t>(type_);
+        key.run_number = run_number_;
+        key.file_number = file_number_;
+        key.event_arg = event_arg_;
+        key.stride_arg = stride_arg_;
+        // Same query with another encoding or batch size sends different messages
+        key.encoding = static_cast<uint32_t>(options_.batch_events) | static_cast<uint32_t>(options_.compress_events) << 1 |
+                       static_cast<uint32_t>(options_.max_batch_words) << 2;
+        key.alg_mask = alg_mask_;
+        key.alg_format = static_cast<uint32_t>(options_.histogram_format);
+        return true;
+    }
+
+    void MonitorQuery::ReplayResult(const CachedResult &result) {
+        if (debug_) LOG_DEBUG("Replaying {} cached metrics..", result.size());
+        for (const auto &record : result) {
+            if (IsCancelled()) return;
+            std::vector<uint32_t> metric_vec = record.payload;
+            send_metric_(metric_vec, record.metric_id);
+        }
+    }
+
+    void MonitorQuery::SendMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id) {
+        // Copy before sending, the sender takes the vector
+        if (record_metrics_) sent_metrics_.push_back({metric_id, metric_vec});
+        send_metric_(metric_vec, metric_id);
+    }
+
+    void MonitorQuery::SendQueryError(QueryError error, uint32_t detail) {
+        LOG_ERROR("Query on {} failed: error {}, detail {}", monitor_file_, static_cast<uint32_t>(error), detail);
+        failed_ = true;
+        std::vector<uint32_t> error_vec = {run_number_, file_number_, static_cast<uint32_t>(error), detail};
+        SendMetric(error_vec, QUERY_ERROR_METRIC);
+    }
+
+    void MonitorQuery::setNumEvent(const std::vector<uint32_t> &args) {
+        uint32_t num_events_ = args.at(2);
+        event_stride_ = args.at(3);
+        event_stride_ = event_stride_ == 0 ? event_stride_ + 1 : event_stride_;
+        process_num_events_ = num_events_ * event_stride_;
+        // 5k events per file so return error if requesting more
+        // TODO set error bit
+        if (process_num_events_ > 5000) process_num_events_ = 5000;
+    }
+
+    void MonitorQuery::setEventNumber(const std::vector<uint32_t> &args) {
+        uint32_t event_number = args.at(2);
+        event_stride_ = event_number;
+        event_stride_ = event_stride_ == 0 ? event_stride_ + 1 : event_stride_;
+        process_num_events_ = event_number + 1;
+        // TODO set error bit
+        if (process_num_events_ > 5000) process_num_events_ = 5000;
+    }
+
+    void MonitorQuery::SelectEvents() {
+        // The events this query wants, bounded by the number of events actually in the file
+        // when it is indexed so out of range requests fail before decoding anything.
+        size_t num_file_events = event_index_.IsValid() ? event_index_.NumEvents() : EVENT_LOOP_MAX;
+        SelectEventRange(num_file_events, selected_events_);
+        last_selected_event_ = selected_events_.empty() ? 0 : selected_events_.back();
+        events_selected_.store(selected_events_.size());
+    }
+
+    void MonitorQuery::SelectEventRange(size_t num_file_events, std::vector<size_t> &selected) const {
+        size_t last_event = std::min({process_num_events_, num_file_events, EVENT_LOOP_MAX});
+        selected.clear();
+        for (size_t evt = 0; evt < last_event; evt += event_stride_) {
+            if (evt == 0 && process_num_events_ != 1) continue;
+            selected.push_back(evt);
+        }
+    }
+
+    void MonitorQuery::MergeStoredPartials() {
+        if (summary_store_ == nullptr || selected_events_.empty()) return;
+        if (!FileVersion::Stat(monitor_file_, file_version_)) {
+            summary_store_ = nullptr;
+            return;
+        }
+        std::vector<size_t> missing;
+        // Exact integer sums, merging stored events gives the same summary as decoding them again
+        size_t num_stored = summary_store_->MergeStored(file_version_, selected_events_, summary_, missing);
+        if (num_stored == 0) return;
+        events_processed_ += num_stored;
+        if (debug_) LOG_DEBUG("Merged {} stored events, decoding {}", num_stored, missing.size());
+        selected_events_ = std::move(missing);
+    }
+
+    void MonitorQuery::StorePartials(EventPartials &partials) {
+        if (store_partials_) summary_store_->Insert(file_version_, partials);
+        partials.clear();
+    }
+
+    void MonitorQuery::KeepPartial(const FileVersion &file, size_t evt_number, const EventPartial &partial,
+                                   EventPartials &partials) {
+        partials.emplace_back(evt_number, CompactPartial(partial));
+        // Flushed as decoding goes, a long query never holds more than a batch of packed events
+        if (partials.size() < PARTIALS_FLUSH_EVENTS) return;
+        summary_store_->Insert(file, partials);
+        partials.clear();
+    }
+
+    std::string MonitorQuery::DataFileName(uint32_t run_number, uint32_t file_number, const std::string &data_dir) {
+        const char *separator = !data_dir.empty() && data_dir.back() != '/' ? "/" : "";
+        return data_dir + separator + "pGRAMS_bin_" + std::to_string(run_number) + "_" + std::to_string(file_number) + ".dat";
+    }
+
+    bool MonitorQuery::ParseDataFileName(const std::string &name, uint32_t &run_number, uint32_t &file_number) {
+        unsigned int run = 0, file = 0;
+        char suffix[8] = {0};
+        if (std::sscanf(name.c_str(), "pGRAMS_bin_%u_%u%7s", &run, &file, suffix) != 3) return false;
+        if (std::string(suffix) != ".dat") return false;
+        run_number = run;
+        file_number = file;
+        return true;
+    }
+
+    void MonitorQuery::setFileName(const std::vector<uint32_t> &args) {
+        run_number_ = args.at(0);
+        file_number_ = args.at(1);
+        monitor_file_ = DataFileName(run_number_, file_number_, DataDir());
+        LOG_INFO("Requested file: {}", monitor_file_);
+    }
+
+    void MonitorQuery::ProcessFile() {
+        // if (!OpenFile()) { return; }
+        if (!OpenDecoder(*process_events_, monitor_file_)) {
+            LOG_ERROR("Failed to load file!");
+        }
+        IndexFile();
+        SelectEvents();
+        if (selected_events_.empty()) {
+            SendQueryError(QueryError::kNoEventsSelected, static_cast<uint32_t>(event_index_.NumEvents()));
+            return;
+        }
+        GetEventMetrics();
+    }
+
+    void MonitorQuery::ProcessFileParallel() {
+        IndexFile();
+        SelectEvents();
+        if (selected_events_.empty()) {
+            SendQueryError(QueryError::kNoEventsSelected, static_cast<uint32_t>(event_index_.NumEvents()));
+            return;
+        }
+        // Only the events that were never summarized before are left to decode
+        MergeStoredPartials();
+        if (selected_events_.empty() && events_processed_.load() > 0) {
+            UpdateMinimalMetrics(last_selected_event_ + 1);
+            return;
+        }
+        // Not worth the decoder startup per worker for a handful of events
+        size_t num_slices = std::min(worker_pool_.NumWorkers(), selected_events_.size() / MIN_EVENTS_PER_SLICE);
+        if (num_slices < 2) {
+            if (!OpenDecoder(*process_events_, monitor_file_)) {
+                LOG_ERROR("Failed to load file!");
+            }
+            GetEventMetrics();
+            return;
+        }
+
+        // Contiguous slices of the selected events, each worker fills its own partial summary.
+        // The pool is shared with other queries so wait on this query's slices only.
+        std::vector<EventPartial> slice_partials(num_slices);
+        std::vector<EventPartials> event_partials(num_slices);
+        std::vector<std::future<void>> slices;
+        size_t slice_size = (selected_events_.size() + num_slices - 1) / num_slices;
+        for (size_t slice = 0; slice < num_slices; slice++) {
+            size_t begin = slice * slice_size;
+            size_t end = std::min(begin + slice_size, selected_events_.size());
+            slices.push_back(worker_pool_.Submit([this, begin, end, slice, &slice_partials, &event_partials]() {
+                SummarizeSlice(begin, end, slice_partials[slice], event_partials[slice]);
+            }));
+        }
+        WorkerPool::GetAll(slices);
+        // Every event decoded is complete even if the query was cancelled, keep them
+        for (auto &partials : event_partials) StorePartials(partials);
+        if (IsCancelled()) return;
+
+        // Integer sums so the reduction gives exactly what the serial loop would have
+        for (const auto &partial : slice_partials) MinimalPipeline::Merge(summary_, partial);
+        UpdateMinimalMetrics(last_selected_event_ + 1);
+    }
+
+    void MonitorQuery::SummarizeSlice(size_t begin, size_t end, EventPartial &summary, EventPartials &partials) {
+        // Each worker needs its own decoder, it walks the headers up to the start of its slice
+        ProcessEvents decoder(light_slot_, false, std::vector<uint16_t>(), false);
+        decoder.UseEventStride(true);
+        if (!OpenDecoder(decoder, monitor_file_)) {
+            LOG_ERROR("Failed to load file!");
+            return;
+        }
+        decoder.SetEventStride(event_stride_);
+
+        FlatEvent flat_event;
+        EventPartial event_partial;
+        size_t event_count = 0;
+        size_t next_selected = begin;
+        while (next_selected < end && !IsCancelled() && NextEvent(decoder)) {
+            if (event_count != selected_events_[next_selected]) {
+                MONITOR_COUNT(kEventsSkipped, 1);
+                event_count++;
+                continue;
+            }
+            {
+                MONITOR_TIME_SCOPE(kEventCopy);
+                flat_event.Fill(decoder.GetEventStruct());
+            }
+            CountDecoded(event_index_, event_count);
+            MONITOR_TIME_SCOPE(kSummaryAlgs);
+            if (!store_partials_) {
+                pipeline_.ProcessEvent(flat_event, summary, alg_mask_);
+            } else {
+                // Summarize the event on its own so it can be stored, then fold it into the slice
+                MinimalPipeline::Clear(event_partial);
+                pipeline_.ProcessEvent(flat_event, event_partial);
+                MinimalPipeline::Merge(summary, event_partial);
+                KeepPartial(file_version_, event_count, event_partial, partials);
+            }
+            events_processed_++;
+            next_selected++;
+            event_count++;
+        }
+    }
+
+    void MonitorQuery::ScanRun() {
+        std::vector<uint32_t> file_numbers;
+        if (!ListRunFiles(file_numbers)) {
+            LOG_ERROR("No files for run {} from file {}", run_number_, file_number_);
+            return;
+        }
+
+        // Index every file and merge what is already stored, one task per file keeps the disk and cores busy
+        std::vector<ScanFile> files(file_numbers.size());
+        std::vector<std::future<void>> prepared;
+        for (size_t i = 0; i < files.size(); i++) {
+            files[i].file_number = file_numbers[i];
+            files[i].path = DataFileName(run_number_, file_numbers[i], DataDir());
+            prepared.push_back(worker_pool_.Submit([this, &files, i]() { PrepareScanFile(files[i]); }));
+        }
+        WorkerPool::GetAll(prepared);
+        scanned_last_file_ = file_numbers.back();
+        if (IsCancelled()) return;
+
+        // Chunks of each file start out on one worker so it walks the file front to back with one
+        // decoder, idle workers steal from the far end of the busy ones
+        const size_t num_workers = std::max<size_t>(worker_pool_.NumWorkers(), 1);
+        size_t total_events = 0;
+        for (const auto &file : files) total_events += file.selected.size();
+        const size_t chunk_events = std::max(MIN_EVENTS_PER_CHUNK,
+                                             (total_events + num_workers * CHUNKS_PER_WORKER - 1) / (num_workers * CHUNKS_PER_WORKER));
+        WorkStealingQueues<ScanChunk> chunks(num_workers);
+        size_t num_chunks = 0;
+        for (size_t f = 0; f < files.size(); f++) {
+            for (size_t begin = 0; begin < files[f].selected.size(); begin += chunk_events) {
+                chunks.Push(f % num_workers, {f, begin, std::min(begin + chunk_events, files[f].selected.size())});
+                num_chunks++;
+            }
+        }
+
+        std::vector<std::future<void>> workers;
+        for (size_t worker = 0; worker < std::min(num_workers, num_chunks); worker++) {
+            workers.push_back(worker_pool_.Submit([this, worker, &chunks, &files]() { ScanWorker(worker, chunks, files); }));
+        }
+        WorkerPool::GetAll(workers);
+        if (debug_) LOG_DEBUG("Scanned {} files, {} chunks, {} stolen", files.size(), num_chunks, chunks.Steals());
+        if (IsCancelled()) return;
+
+        SendRunMetrics(files);
+    }
+
+    bool MonitorQuery::ListRunFiles(std::vector<uint32_t> &file_numbers) const {
+        DIR *dir = opendir(DataDir().c_str());
+        if (dir == nullptr) return false;
+        while (struct dirent *entry = readdir(dir)) {
+            uint32_t run = 0, file = 0;
+            if (!ParseDataFileName(entry->d_name, run, file) || run != run_number_) continue;
+            if (file < file_number_ || (last_file_number_ != 0 && file > last_file_number_)) continue;
+            file_numbers.push_back(file);
+        }
+        closedir(dir);
+        std::sort(file_numbers.begin(), file_numbers.end());
+        if (file_numbers.size() > MAX_SCAN_FILES) {
+            LOG_WARNING("Run {} has {} files, scanning the first {}", run_number_, file_numbers.size(), MAX_SCAN_FILES);
+            file_numbers.resize(MAX_SCAN_FILES);
+        }
+        return !file_numbers.empty();
+    }
+
+    void MonitorQuery::PrepareScanFile(ScanFile &file) {
+        {
+            MONITOR_TIME_SCOPE(kIndexFile);
+            if (!file.mapped_file.Open(file.path) || !file.event_index.LoadOrBuild(file.mapped_file)) {
+                LOG_ERROR("Failed to index {}, event range is unbounded!", file.path);
+            }
+        }
+        size_t num_file_events = file.event_index.IsValid() ? file.event_index.NumEvents() : EVENT_LOOP_MAX;
+        SelectEventRange(num_file_events, file.selected);
+        events_selected_ += file.selected.size();
+        if (summary_store_ == nullptr || file.selected.empty()) return;
+
+        // Only the events never summarized before are left to decode
+        file.versioned = FileVersion::Stat(file.path, file.version);
+        if (!file.versioned) return;
+        std::vector<size_t> missing;
+        size_t num_stored = summary_store_->MergeStored(file.version, file.selected, file.summary, missing);
+        file.num_events += num_stored;
+        events_processed_ += num_stored;
+        file.selected = std::move(missing);
+    }
+
+    void MonitorQuery::ScanWorker(size_t worker, WorkStealingQueues<ScanChunk> &chunks, std::vector<ScanFile> &files) {
+        // The decoder is kept between chunks, the next chunk of the same file carries on from where it stopped
+        std::unique_ptr<ProcessEvents> decoder;
+        size_t decoder_file = 0;
+        size_t event_count = 0;
+        FlatEvent flat_event;
+        EventPartial chunk_summary;
+        EventPartial event_partial;
+        EventPartials partials;
+        ScanChunk chunk{};
+        while (!IsCancelled() && chunks.Pop(worker, chunk)) {
+            ScanFile &file = files[chunk.file];
+            if (decoder == nullptr || decoder_file != chunk.file || event_count > file.selected[chunk.begin]) {
+                decoder = std::make_unique<ProcessEvents>(light_slot_, false, std::vector<uint16_t>(), false);
+                decoder->UseEventStride(true);
+                if (!OpenDecoder(*decoder, file.path)) {
+                    LOG_ERROR("Failed to load file {}", file.path);
+                    decoder.reset();
+                    continue;
+                }
+                decoder->SetEventStride(event_stride_);
+                decoder_file = chunk.file;
+                event_count = 0;
+            }
+            if (file.event_index.IsValid()) {
+                const auto &first = file.event_index.At(file.selected[chunk.begin]);
+                const auto &last = file.event_index.At(file.selected[chunk.end - 1]);
+                file.mapped_file.AdviseWillNeed(first.offset, last.offset + last.size - first.offset);
+            }
+
+            MinimalPipeline::Clear(chunk_summary);
+            const bool store = store_partials_ && file.versioned;
+            size_t next_selected = chunk.begin;
+            while (next_selected < chunk.end && !IsCancelled() && NextEvent(*decoder)) {
+                if (event_count != file.selected[next_selected]) {
+                    MONITOR_COUNT(kEventsSkipped, 1);
+                    event_count++;
+                    continue;
+                }
+                {
+                    MONITOR_TIME_SCOPE(kEventCopy);
+                    flat_event.Fill(decoder->GetEventStruct());
+                }
+                CountDecoded(file.event_index, event_count);
+                MONITOR_TIME_SCOPE(kSummaryAlgs);
+                if (!store) {
+                    pipeline_.ProcessEvent(flat_event, chunk_summary);
+                } else {
+                    MinimalPipeline::Clear(event_partial);
+                    pipeline_.ProcessEvent(flat_event, event_partial);
+                    MinimalPipeline::Merge(chunk_summary, event_partial);
+                    KeepPartial(file.version, event_count, event_partial, partials);
+                }
+                events_processed_++;
+                next_selected++;
+                event_count++;
+            }
+            // The decoder ran out before the chunk did, the next chunk has to reopen the file
+            if (next_selected < chunk.end) decoder.reset();
+            if (!partials.empty()) summary_store_->Insert(file.version, partials);
+            partials.clear();
+
+            std::lock_guard<std::mutex> lock(file.summary_mutex);
+            MinimalPipeline::Merge(file.summary, chunk_summary);
+            file.num_events += next_selected - chunk.begin;
+        }
+    }
+
+    void MonitorQuery::SendRunMetrics(std::vector<ScanFile> &files) {
+        MONITOR_TIME_SCOPE(kSerialize);
+        // Integer sums, the run total is exactly what one pass over every file would give
+        size_t num_events = 0;
+        for (auto &file : files) {
+            MinimalPipeline::Merge(summary_, file.summary);
+            num_events += file.num_events;
+            if (!per_file_metrics_ || file.num_events == 0) continue;
+            lbw_metrics_.setRunNumber(run_number_);
+            lbw_metrics_.setFileNumber(file.file_number);
+            lbw_metrics_.setEvtNumber(0);
+            pipeline_.UpdateMetrics(file.summary, lbw_metrics_, metrics_, alg_mask_);
+            auto tmp_vec = lbw_metrics_.serialize();
+            SendMetric(tmp_vec, LBW_METRIC);
+        }
+
+        lbw_metrics_.setRunNumber(run_number_);
+        lbw_metrics_.setFileNumber(files.size());
+        lbw_metrics_.setEvtNumber(num_events);
+        pipeline_.UpdateMetrics(summary_, lbw_metrics_, metrics_, alg_mask_);
+        auto tmp_vec = lbw_metrics_.serialize();
+        SendMetric(tmp_vec, RUN_LBW_METRIC);
+        if (debug_) lbw_metrics_.print();
+
+        alg_metrics_.clear();
+        pipeline_.SerializeMetrics(summary_, {run_number_, static_cast<uint32_t>(files.size()), static_cast<uint32_t>(num_events)},
+                                   alg_metrics_, alg_mask_);
+        for (auto &alg_metric : alg_metrics_) SendMetric(alg_metric.payload, alg_metric.metric_id);
+        MinimalPipeline::Clear(summary_);
+    }
+
+    bool MonitorQuery::OpenDecoder(ProcessEvents &decoder, const std::string &path) const {
+        MONITOR_TIME_SCOPE(kOpenFile);
+        return decoder.OpenFile(path);
+    }
+
+    void MonitorQuery::CountDecoded(const EventIndex &event_index, size_t evt_number) {
+        MONITOR_COUNT(kEventsDecoded, 1);
+        MONITOR_COUNT(kBytesRead, event_index.IsValid() ? event_index.At(evt_number).size : 0);
+        (void)event_index;
+        (void)evt_number;
+    }
+
+    void MonitorQuery::IndexFile() {
+        MONITOR_TIME_SCOPE(kIndexFile);
+        // Keep the file mapped between queries, repeated queries on the same file don't remap it
+        if (mapped_file_.Path() != monitor_file_ && !mapped_file_.Open(monitor_file_)) {
+            LOG_ERROR("Failed to map file!");
+        }
+        // Index the file once, later queries on the same file reuse the sidecar
+        if (!event_index_.LoadOrBuild(mapped_file_)) {
+            LOG_ERROR("Failed to index file, event range is unbounded!");
+        }
+    }
+
+    void MonitorQuery::GetEventMetrics() {
+        if (debug_) LOG_DEBUG("entering processing");
+        // Set the decoder stride. When requesting 1 event we want to make one stride directly to the
+        // desired event. This is because in the decoder striding skips filling the data structure for
+        // the intermediate events. Thus, it is more efficient to stride than to get each event.
+        process_events_->SetEventStride(event_stride_);
+        PrefetchSelected();
+
+        // The query type is fixed so pick the metrics once, not per event
+        size_t event_count = 0;
+        if (type_ == QueryType::kMinimal) {
+            event_count = ConsumeEvents([this](const FlatEvent &event, size_t evt_number) { CreateMinimalMetrics(event, evt_number); });
+        } else {
+            event_count = ConsumeEvents([this](const FlatEvent &event, size_t evt_number) { CreateEventMetrics(event, evt_number); });
+        }
+        range_prefetcher_.Stop();
+        StorePartials(new_partials_);
+        if (IsCancelled()) return;
+
+        // The number of desired events have been processed and metrics created
+        // so update the metrics and send them
+        if (type_ == QueryType::kMinimal) UpdateMinimalMetrics(event_count);
+        else UpdateEventMetrics(event_count);
+    }
+
+    template <typename Creator>
+    size_t MonitorQuery::ConsumeEvents(Creator &&create_metrics) {
+        // Decode on a producer thread while the metrics are created here. The decoded events travel
+        // through a bounded lock-free queue in pooled buffers, when the pool is empty the producer
+        // waits for the consumer to hand one back.
+        std::atomic_bool decode_done{false};
+        // An exception is passed back to the query's thread, not left to terminate the producer
+        std::exception_ptr decode_error;
+        std::thread producer([this, &decode_done, &decode_error]() {
+            try {
+                DecodeEvents(decode_done);
+            } catch (...) {
+                decode_error = std::current_exception();
+                decode_done.store(true, std::memory_order_release);
+            }
+        });
+
+        size_t event_count = 0;
+        DecodedEvent decoded{};
+        try {
+            while (true) {
+                if (!decoded_events_.Pop(decoded)) {
+                    // Only finished once the producer is done and everything it pushed has been consumed
+                    if (decode_done.load(std::memory_order_acquire) && decoded_events_.Empty()) break;
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (!IsCancelled()) {
+                    if (debug_) LOG_DEBUG("Processing event: {}", decoded.event_number);
+                    // Calculate event metrics
+                    create_metrics(*decoded.event, decoded.event_number);
+                    event_count = decoded.event_number + 1;
+                    events_processed_++;
+                }
+                free_events_.Push(decoded.event);
+            }
+        } catch (...) {
+            // Stop the producer before the exception leaves, it is still using this query
+            Cancel();
+            producer.join();
+            throw;
+        }
+        producer.join();
+        if (decode_error) std::rethrow_exception(decode_error);
+        return event_count;
+    }
+
+    void MonitorQuery::DecodeEvents(std::atomic_bool &done) {
+        size_t event_count = 0;
+        size_t next_selected = 0;
+        while (next_selected < selected_events_.size() && !IsCancelled() && NextEvent(*process_events_)) {
+            // the decoder must iterate through each event since we don't know a priori the event size
+            if (event_count != selected_events_[next_selected]) {
+                MONITOR_COUNT(kEventsSkipped, 1);
+                event_count++;
+                continue;
+            }
+            // Backpressure, wait for the consumer to return a buffer to the pool
+            FlatEvent *buffer = nullptr;
+            while (!free_events_.Pop(buffer)) {
+                if (IsCancelled()) {
+                    done.store(true, std::memory_order_release);
+                    return;
+                }
+                std::this_thread::yield();
+            }
+            // Pack the decoder's event into the pooled flat layout, the algorithms only read it
+            // and keep their own reusable buffers so there are no allocations per event.
+            {
+                MONITOR_TIME_SCOPE(kEventCopy);
+                buffer->Fill(process_events_->GetEventStruct(), channel_selection_);
+            }
+            CountDecoded(event_index_, event_count);
+            if (event_index_.IsValid()) range_prefetcher_.SetConsumerOffset(event_index_.At(event_count).offset);
+            // Never full, the queue has room for every buffer in the pool
+            decoded_events_.Push({buffer, event_count});
+            next_selected++;
+            event_count++;
+        }
+        done.store(true, std::memory_order_release);
+    }
+
+    void MonitorQuery::QueueMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id) {
+        if (metric_vec.empty()) return;
+        if (metric_batch_.Add(metric_id, metric_vec)) return;
+        // Batch is full, send it and start the next one with this metric
+        FlushMetrics();
+        metric_batch_.Add(metric_id, metric_vec);
+    }
+
+    void MonitorQuery::FlushMetrics() {
+        if (metric_batch_.Empty()) return;
+        if (debug_) LOG_DEBUG("Sending batch of {} metrics..", metric_batch_.NumRecords());
+        auto batch = metric_batch_.TakeWords();
+        SendMetric(batch, EVENT_BATCH_METRIC);
+    }
+
+    void MonitorQuery::CreateMinimalMetrics(const FlatEvent & event, size_t evt_number) {
+        MONITOR_TIME_SCOPE(kSummaryAlgs);
+        if (!store_partials_) {
+            pipeline_.ProcessEvent(event, summary_, alg_mask_);
+            if (debug_) LOG_DEBUG("Processed algorithms 0x{:x}..", alg_mask_);
+            return;
+        }
+        // Keep this event's partial for the store, later queries on the file skip decoding it
+        MinimalPipeline::Clear(event_partial_);
+        pipeline_.ProcessEvent(event, event_partial_);
+        if (debug_) LOG_DEBUG("Processed algorithms 0x{:x}..", alg_mask_);
+        MinimalPipeline::Merge(summary_, event_partial_);
+        KeepPartial(file_version_, evt_number, event_partial_, new_partials_);
+    }
+
+    void MonitorQuery::UpdateMinimalMetrics(size_t evt_number) {
+        MONITOR_TIME_SCOPE(kSerialize);
+        lbw_metrics_.setRunNumber(run_number_);
+        lbw_metrics_.setFileNumber(file_number_);
+        lbw_metrics_.setEvtNumber(0); // set to 0 since the metric is an aggregate across events
+        // Fields of the algorithms not selected stay zero
+        pipeline_.UpdateMetrics(summary_, lbw_metrics_, metrics_, alg_mask_);
+
+        auto tmp_vec = lbw_metrics_.serialize();
+        SendMetric(tmp_vec, LBW_METRIC);
+        if (debug_) lbw_metrics_.print();
+
+        // Then any metrics the algorithms make of their own
+        alg_metrics_.clear();
+        pipeline_.SerializeMetrics(summary_, {run_number_, file_number_, static_cast<uint32_t>(evt_number)}, alg_metrics_, alg_mask_);
+        for (auto &alg_metric : alg_metrics_) SendMetric(alg_metric.payload, alg_metric.metric_id);
+        // Clear the metrics for the next file
+        MinimalPipeline::Clear(summary_);
+    }
+
+    void MonitorQuery::CreateEventMetrics(const FlatEvent & event, size_t /*evt_number*/) {
+        {
+            MONITOR_TIME_SCOPE(kChargeAlgs);
+            charge_algs_.GetChargeEvent(event);
+            HitFinder::FindHits(event, hit_list_);
+        }
+        if (debug_) LOG_DEBUG("Processed charge event, {} hits..", hit_list_.Size());
+        {
+            MONITOR_TIME_SCOPE(kLightAlgs);
+            num_light_rois_ = light_algs_.GetLightEvent(event);
+            LightPulseFinder::FindPulses(event, pulse_list_);
+        }
+        if (debug_) LOG_DEBUG("Processed light event..");
+    }
+
+    uint32_t MonitorQuery::ChargeEventMetric(size_t channel, size_t evt_number, std::vector<uint32_t> &metric_vec) {
+        if (!options_.compress_events) {
+            metric_vec = charge_algs_.UpdateChargeEvent(charge_event_metric_, channel);
+            return CHARGE_EVENT_METRIC;
+        }
+        // Compressed payload: run, file, event, channel then the encoded waveform
+        metric_vec = {run_number_, file_number_, static_cast<uint32_t>(evt_number), static_cast<uint32_t>(channel)};
+        charge_algs_.EncodeChargeEvent(channel, metric_vec);
+        return COMPRESSED_CHARGE_EVENT_METRIC;
+    }
+
+    uint32_t MonitorQuery::LightEventMetric(size_t roi, size_t evt_number, std::vector<uint32_t> &metric_vec) {
+        if (!options_.compress_events) {
+            metric_vec = light_algs_.UpdateLightEvent(light_event_metric_, roi);
+            return LIGHT_EVENT_METRIC;
+        }
+        // Compressed payload: run, file, event, channel then the encoded waveform
+        metric_vec = {run_number_, file_number_, static_cast<uint32_t>(evt_number)};
+        if (!light_algs_.EncodeLightEvent(roi, metric_vec)) metric_vec.clear();
+        return COMPRESSED_LIGHT_EVENT_METRIC;
+    }
+
+    void MonitorQuery::UpdateEventMetrics(size_t evt_number) {
+        MONITOR_TIME_SCOPE(kSerialize);
+        if (debug_) LOG_DEBUG("Updating Event Metrics..");
+        charge_event_metric_.setRunNumber(run_number_);
+        charge_event_metric_.setFileNumber(file_number_);
+        charge_event_metric_.setEvtNumber(evt_number);
+        light_event_metric_.setRunNumber(run_number_);
+        light_event_metric_.setFileNumber(file_number_);
+        light_event_metric_.setEvtNumber(evt_number);
+        if (choose_random_) {
+            if (debug_) LOG_DEBUG("Random charge ch: {}", random_charge_channel_);
+            std::vector<uint32_t> tmp_vec;
+            uint32_t metric_id = ChargeEventMetric(random_charge_channel_, evt_number, tmp_vec);
+            SendMetric(tmp_vec, metric_id);
+
+            // No ROI to pick from in an event without cosmic ROIs
+            if (num_light_rois_ > 0 && light_algs_.isLightRoi()) {
+                auto light_uniform = std::uniform_int_distribution<size_t>(0, num_light_rois_ - 1);
+                size_t light_roi = light_uniform(random_generator_);
+                if (debug_) LOG_DEBUG("Random light roi: {}", light_roi);
+                metric_id = LightEventMetric(light_roi, evt_number, tmp_vec);
+                SendMetric(tmp_vec, metric_id);
+            }
+        } else if (options_.batch_events) {
+            // Pack the whole event into as few framed messages as the batch size allows
+            for (size_t i = 0; i < NUM_CHARGE_CHANNELS && !IsCancelled(); i++) {
+                std::vector<uint32_t> tmp_vec;
+                uint32_t metric_id = ChargeEventMetric(i, evt_number, tmp_vec);
+                QueueMetric(tmp_vec, metric_id);
+            }
+            for (size_t i = 0; i < num_light_rois_ && !IsCancelled(); i++) {
+                std::vector<uint32_t> tmp_vec;
+                uint32_t metric_id = LightEventMetric(i, evt_number, tmp_vec);
+                QueueMetric(tmp_vec, metric_id);
+            }
+            FlushMetrics();
+        } else {
+            // One command per metric, paced by the link budget rather than a fixed sleep
+            for (size_t i = 0; i < NUM_CHARGE_CHANNELS && !IsCancelled(); i++) {
+                std::vector<uint32_t> tmp_vec;
+                uint32_t metric_id = ChargeEventMetric(i, evt_number, tmp_vec);
+                if (debug_) LOG_DEBUG("Updated charge event..");
+                SendMetric(tmp_vec, metric_id);
+            }
+            for (size_t i = 0; i < num_light_rois_ && !IsCancelled(); i++) {
+                std::vector<uint32_t> tmp_vec;
+                uint32_t metric_id = LightEventMetric(i, evt_number, tmp_vec);
+                if (debug_) LOG_DEBUG("Updated light event..");
+                SendMetric(tmp_vec, metric_id);
+            }
+        }
+        if (!IsCancelled()) {
+            std::vector<uint32_t> hit_vec;
+            HitFinder::SerializeHits(hit_list_, {run_number_, file_number_, static_cast<uint32_t>(evt_number)}, hit_vec);
+            SendMetric(hit_vec, HIT_LIST_METRIC);
+            std::vector<uint32_t> pulse_vec;
+            LightPulseFinder::SerializePulses(pulse_list_, {run_number_, file_number_, static_cast<uint32_t>(evt_number)}, pulse_vec);
+            SendMetric(pulse_vec, LIGHT_PULSE_METRIC);
+        }
+        // Make sure to clear it
+        charge_algs_.Clear();
+        light_algs_.Clear();
+    }
+
+} // data_monitor
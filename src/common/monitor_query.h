@@ -0,0 +1,317 @@
+//
+// One monitor query, owns everything needed to process a file so queries can run concurrently.
+//
+
+#ifndef MONITOR_QUERY_H
+#define MONITOR_QUERY_H
+
+#include "process_events.h"
+#include "light_algs.h"
+#include "charge_algs.h"
+#include "monitor_pipeline.h"
+#include "event_index.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+#include "spsc_queue.h"
+#include "metric_batch.h"
+#include "result_cache.h"
+#include "summary_store.h"
+#include "work_stealing_queues.h"
+#include "file_prefetcher.h"
+#include "channel_selection.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace data_monitor {
+
+    // Settings copied from the monitor when the query is created, so changing them
+    // does not affect queries already queued or running
+    struct QueryOptions {
+        bool batch_events = true;
+        bool compress_events = false;
+        size_t max_batch_words = 4096;
+        bool debug = false;
+        uint32_t random_seed = 0;
+        HistogramFormat histogram_format = HistogramFormat::kSparse;
+        // Directory the readout files are read from, MonitorQuery::DATA_DIR when empty
+        std::string data_dir;
+    };
+
+class MonitorQuery {
+public:
+
+    enum class QueryType : uint8_t {
+        kMinimal,
+        kEvent,
+        kRunScan
+    };
+
+    // Reason code of a QUERY_ERROR_METRIC
+    enum class QueryError : uint32_t {
+        // Past the end of the file or an empty file, the detail is the number of events in the file
+        kNoEventsSelected = 1
+    };
+
+    // Sends a serialized metric on the status link
+    using MetricSender = std::function<void(std::vector<uint32_t> &metric_vec, uint32_t metric_id)>;
+
+    /**
+    *  @param [in] type:  Minimal summary or single event query
+    *  @param [in] args:  Command arguments, {run, file, num_evts, stride[, alg_mask]} or {run, file, event, random}.
+    *                      alg_mask is the OR of the MinimalPipeline ALG_IDs to run, 0 or absent runs all of them.
+    *                      A random event query only reads its one charge channel, its hit list holds that channel's hits.
+    *                      A run scan takes {run, first_file, last_file, num_evts, stride[, per_file]}, last_file 0
+    *                      runs to the last file of the run and num_evts 0 takes every event of each file.
+    *  @param [in] worker_pool:  Shared workers for splitting a minimal summary
+    *  @param [in] send_metric:  Where to send the finished metrics
+    *  @param [in] options:  Encoding and batching settings
+    *  @param [in] result_cache:  Finished results shared between queries, nullptr to always decode
+    *  @param [in] summary_store:  Per-event summary partials shared between queries, nullptr to always decode
+    *  @param [in] next_file_prefetcher:  Warms the run's next file once the query is done, nullptr to not prefetch
+    */
+    MonitorQuery(QueryType type, const std::vector<uint32_t> &args, WorkerPool &worker_pool,
+                 MetricSender send_metric, const QueryOptions &options, ResultCache *result_cache = nullptr,
+                 SummaryStore *summary_store = nullptr, FilePrefetcher *next_file_prefetcher = nullptr);
+    ~MonitorQuery() = default;
+
+    // Process the file and send the metrics, runs on the calling thread. Replays the
+    // cached metrics instead if the same query already ran on this version of the file.
+    void Run();
+
+    // Cancellation token, checked between events and between sent metrics
+    void Cancel() { cancelled_.store(true); }
+    bool IsCancelled() const { return cancelled_.load(); }
+    // Nothing could be sent for the request, a QUERY_ERROR_METRIC went out instead
+    bool Failed() const { return failed_; }
+
+    // Progress
+    size_t EventsProcessed() const { return events_processed_.load(); }
+    size_t EventsSelected() const { return events_selected_.load(); }
+    QueryType Type() const { return type_; }
+    const std::string& MonitorFile() const { return monitor_file_; }
+
+    // Where the readout writes its files, pGRAMS_bin_<run>_<file>.dat
+    //constexpr static const char* DATA_DIR = "/home/pgrams/data/nov2025_integration_data/readout_data/";
+    //constexpr static const char* DATA_DIR = "/home/pgrams/data/readout_data/";
+    constexpr static const char* DATA_DIR = "/home/pgrams/data/jan13_integration/readout_data/";
+    static std::string DataFileName(uint32_t run_number, uint32_t file_number, const std::string &data_dir = DATA_DIR);
+    // Returns false if the name is not a readout data file
+    static bool ParseDataFileName(const std::string &name, uint32_t &run_number, uint32_t &file_number);
+
+private:
+
+    // Command/Conrol helper fucntions
+    void setFileName(const std::vector<uint32_t>& args);
+    std::string DataDir() const { return options_.data_dir.empty() ? DATA_DIR : options_.data_dir; }
+    void setNumEvent(const std::vector<uint32_t>& args);
+    void setEventNumber(const std::vector<uint32_t>& args);
+    void SelectEvents();
+    void IndexFile();
+    bool OpenDecoder(ProcessEvents &decoder, const std::string &path) const;
+    // Instrumentation counters for one decoded event, compiled out with the rest
+    static void CountDecoded(const EventIndex &event_index, size_t evt_number);
+    // Merge the stored partials of the selected events and keep only the ones left to decode
+    void MergeStoredPartials();
+    // Sends a QUERY_ERROR_METRIC and marks the query failed
+    void SendQueryError(QueryError error, uint32_t detail);
+    void StorePartials(EventPartials &partials);
+    // Pack an event's partial for the store, inserting every PARTIALS_FLUSH_EVENTS events
+    void KeepPartial(const FileVersion &file, size_t evt_number, const EventPartial &partial, EventPartials &partials);
+    // Dense selections are streamed ahead of the decoder, sparse ones get a hint per event
+    void PrefetchSelected();
+    // The next file of the run is usually the next one asked for
+    void PrefetchNextFile(uint32_t last_file_number);
+
+    void ProcessFile();
+    void ProcessFileParallel();
+    void GetEventMetrics();
+    // Hands each decoded event to create_metrics, a template so the per-event call is direct.
+    // Returns the number of the last event plus one.
+    template <typename Creator>
+    size_t ConsumeEvents(Creator &&create_metrics);
+    void DecodeEvents(std::atomic_bool &done);
+    void SummarizeSlice(size_t begin, size_t end, EventPartial &summary, EventPartials &partials);
+    // Pick the events to process out of a file with num_file_events events
+    void SelectEventRange(size_t num_file_events, std::vector<size_t> &selected) const;
+
+    // Run scan, every file of a run merged into one summary
+    struct ScanFile {
+        uint32_t file_number = 0;
+        std::string path;
+        FileVersion version;
+        bool versioned = false;  // stat'ed, so its partials can be stored
+        MappedFile mapped_file;
+        EventIndex event_index;
+        // Left to decode after merging the stored events
+        std::vector<size_t> selected;
+        // Chunks finish in any order, each merges in under the lock
+        std::mutex summary_mutex;
+        EventPartial summary;
+        size_t num_events = 0;
+    };
+    // Range of a file's selected events, the unit the workers share
+    struct ScanChunk {
+        size_t file;
+        size_t begin;
+        size_t end;
+    };
+    void ScanRun();
+    bool ListRunFiles(std::vector<uint32_t> &file_numbers) const;
+    void PrepareScanFile(ScanFile &file);
+    void ScanWorker(size_t worker, WorkStealingQueues<ScanChunk> &chunks, std::vector<ScanFile> &files);
+    void SendRunMetrics(std::vector<ScanFile> &files);
+
+    // Minimal metrics
+    void CreateMinimalMetrics(const FlatEvent & event, size_t evt_number);
+    void UpdateMinimalMetrics(size_t evt_number);
+
+    // Send events
+    void CreateEventMetrics(const FlatEvent & event, size_t evt_number);
+    void UpdateEventMetrics(size_t evt_number);
+
+    // Cache lookup and replay
+    bool MakeResultKey(ResultKey &key) const;
+    void ReplayResult(const CachedResult &result);
+
+    // Sends a metric, keeping a copy when the result is going to be cached
+    void SendMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id);
+    void QueueMetric(std::vector<uint32_t> &metric_vec, uint32_t metric_id);
+    void FlushMetrics();
+    // Event metric in the selected encoding, returns the metric ID to send it with
+    uint32_t ChargeEventMetric(size_t channel, size_t evt_number, std::vector<uint32_t> &metric_vec);
+    uint32_t LightEventMetric(size_t roi, size_t evt_number, std::vector<uint32_t> &metric_vec);
+
+    QueryType type_;
+    QueryOptions options_;
+    WorkerPool &worker_pool_;
+    MetricSender send_metric_;
+    ResultCache *result_cache_;
+    // Everything sent by this query, only kept while there is a cache to put it in
+    CachedResult sent_metrics_;
+    bool record_metrics_ = false;
+    SummaryStore *summary_store_;
+    FilePrefetcher *next_file_prefetcher_;
+    // Follows the decoder through the selected events of a dense query
+    FilePrefetcher range_prefetcher_;
+    FileVersion file_version_;
+    // Events summarized by this query and not yet added to the store
+    EventPartials new_partials_;
+    // One event's partial before it is packed
+    EventPartial event_partial_;
+
+    std::unique_ptr<ProcessEvents> process_events_;
+    // Pooled decode buffers passed between the decode and analysis threads, each buffer is
+    // reused for every event so the flat buffers are only sized once
+    struct DecodedEvent {
+        FlatEvent *event;
+        size_t event_number;
+    };
+    constexpr static size_t PIPELINE_DEPTH = 4;
+    std::array<FlatEvent, PIPELINE_DEPTH> event_pool_;
+    // One spare slot since the ring buffer holds capacity - 1 entries
+    SpscQueue<FlatEvent*, 2 * PIPELINE_DEPTH> free_events_;
+    SpscQueue<DecodedEvent, 2 * PIPELINE_DEPTH> decoded_events_;
+    MappedFile mapped_file_;
+    EventIndex event_index_;
+
+    std::mt19937 random_generator_;
+
+    constexpr static uint16_t light_slot_ = 16;
+    std::vector<size_t> selected_events_;
+    size_t last_selected_event_ = 0;
+
+    // The event step size, analyze every N events
+    size_t process_num_events_ = 0;
+    size_t event_stride_ = 500;
+    // Set a hard upper limit to ensure no infinite loops while decoding
+    constexpr static size_t EVENT_LOOP_MAX = 10000;
+    // Smallest slice of selected events worth handing to a worker
+    constexpr static size_t MIN_EVENTS_PER_SLICE = 8;
+    // Run scans split files into chunks of at least this many events, each chunk may cost
+    // a decoder walking the file headers up to it so they are kept well above a slice
+    constexpr static size_t MIN_EVENTS_PER_CHUNK = 64;
+    // Chunks per worker, enough for stealing to even out files of different sizes
+    constexpr static size_t CHUNKS_PER_WORKER = 4;
+    constexpr static size_t MAX_SCAN_FILES = 1024;
+    // Packed event partials held before they go into the store, a few hundred KiB per producer
+    constexpr static size_t PARTIALS_FLUSH_EVENTS = 256;
+    // Selected events covering at least 1/N of the bytes between the first and last are streamed
+    constexpr static uint64_t DENSE_SELECTION_FRACTION = 4;
+    // Start of the next file warmed after a query, about a tenth of a full file
+    constexpr static uint64_t NEXT_FILE_PREFETCH_BYTES = 128 * 1024 * 1024;
+
+    // This struct will hold the metrics
+    LowBwTpcMonitor lbw_metrics_;
+    TpcMonitor metrics_;
+    TpcMonitorChargeEvent charge_event_metric_;
+    TpcMonitorLightEvent light_event_metric_;
+
+    // Define the metric algorithm classes, the event queries keep the waveforms in these
+    LightAlgs light_algs_;
+    ChargeAlgs charge_algs_;
+    // Hits of the requested event, sent after its waveforms
+    HitList hit_list_;
+    LightPulseList pulse_list_;
+    // Minimal summaries run through the pipeline, only the selected algorithms
+    MinimalPipeline pipeline_;
+    EventPartial summary_;
+    uint32_t alg_mask_ = MinimalPipeline::ALL_ALGS;
+    // Per-event partials are only complete, and so only stored, when every algorithm runs
+    bool store_partials_ = false;
+    std::vector<AlgMetric> alg_metrics_;
+
+    MetricBatch metric_batch_;
+
+    std::string monitor_file_;
+    bool debug_;
+    bool choose_random_ = false;
+    size_t random_charge_channel_ = 0;
+    // Channels the decoded events are packed with, everything but for a random single channel query
+    ChannelSelection channel_selection_;
+    size_t num_light_rois_ = 0;
+    uint32_t run_number_ = 0;
+    uint32_t file_number_ = 0;
+    // The request as received, part of the cache key
+    uint32_t event_arg_ = 0;
+    uint32_t stride_arg_ = 0;
+    // Run scan file range and whether to also send each file's LBW
+    uint32_t last_file_number_ = 0;
+    bool per_file_metrics_ = false;
+    // Last file a run scan found, where the next file prefetch continues from
+    uint32_t scanned_last_file_ = 0;
+
+    std::atomic_bool cancelled_{false};
+    bool failed_ = false;
+    std::atomic<size_t> events_processed_{0};
+    std::atomic<size_t> events_selected_{0};
+
+};
+
+    // Metric IDs on the status link
+    constexpr static uint32_t LBW_METRIC = 0x4001;
+    constexpr static uint32_t CHARGE_EVENT_METRIC = 0x4002;
+    constexpr static uint32_t LIGHT_EVENT_METRIC = 0x4003;
+    constexpr static uint32_t EVENT_BATCH_METRIC = 0x4004;
+    // Optional compressed event waveforms, see waveform_codec.h
+    constexpr static uint32_t COMPRESSED_CHARGE_EVENT_METRIC = 0x4005;
+    constexpr static uint32_t COMPRESSED_LIGHT_EVENT_METRIC = 0x4006;
+    // Run scan total, LBW layout with the file number holding the number of files merged.
+    // Each file's own LBW_METRIC goes first when asked for, the algorithm metrics follow.
+    constexpr static uint32_t RUN_LBW_METRIC = 0x4010;
+    // Sent in place of any metrics when a query can't be answered: run, file, QueryError, detail
+    constexpr static uint32_t QUERY_ERROR_METRIC = 0x4011;
+    // Charge ADC spectra after the LBW metric, see AdcHistogramAlg::ADC_HISTOGRAM_METRIC (0x400A),
+    // then per-channel hit rates, HitFinderAlg::HIT_SUMMARY_METRIC (0x400B), and light pulses &
+    // coincidences, LightPulseAlg::LIGHT_PULSE_SUMMARY_METRIC (0x400D). Event queries end with
+    // the event's HIT_LIST_METRIC (0x400C) and LIGHT_PULSE_METRIC (0x400E)
+
+} // data_monitor
+
+#endif //MONITOR_QUERY_H
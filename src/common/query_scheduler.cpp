@@ -0,0 +1,126 @@
+//
+// Runs monitor queries in the background so commands are never blocked by a long query.
+//
+
+#include "query_scheduler.h"
+#include "logger.h"
+#include <algorithm>
+#include <exception>
+
+namespace data_monitor {
+
+    QueryScheduler::QueryScheduler(size_t max_concurrent) {
+        if (max_concurrent == 0) max_concurrent = 1;
+        for (size_t i = 0; i < max_concurrent; i++) {
+            runners_.emplace_back([this]() { RunnerLoop(); });
+        }
+    }
+
+    QueryScheduler::~QueryScheduler() {
+        CancelAll();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        job_cv_.notify_all();
+        for (auto &runner : runners_) runner.join();
+    }
+
+    uint32_t QueryScheduler::Submit(std::unique_ptr<MonitorQuery> query) {
+        uint32_t id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = next_id_++;
+            if (next_id_ == 0) next_id_ = 1; // 0 is reserved for "all jobs"
+            queued_.push_back(std::make_shared<Job>(Job{id, JobState::kQueued, std::move(query)}));
+        }
+        job_cv_.notify_one();
+        return id;
+    }
+
+    bool QueryScheduler::Cancel(uint32_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto queued = std::find_if(queued_.begin(), queued_.end(), [id](const auto &job) { return job->id == id; });
+        if (queued != queued_.end()) {
+            (*queued)->state = JobState::kCancelled;
+            finished_.push_back(MakeStatus(**queued));
+            queued_.erase(queued);
+            if (finished_.size() > FINISHED_HISTORY) finished_.pop_front();
+            return true;
+        }
+        // The runner records the final state once the query returns
+        for (auto &job : running_) {
+            if (job->id != id) continue;
+            job->query->Cancel();
+            return true;
+        }
+        return false;
+    }
+
+    void QueryScheduler::CancelAll() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &job : queued_) {
+            job->state = JobState::kCancelled;
+            finished_.push_back(MakeStatus(*job));
+        }
+        queued_.clear();
+        while (finished_.size() > FINISHED_HISTORY) finished_.pop_front();
+        for (auto &job : running_) job->query->Cancel();
+    }
+
+    std::vector<QueryScheduler::JobStatus> QueryScheduler::Status() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<JobStatus> status;
+        status.reserve(running_.size() + queued_.size() + finished_.size());
+        for (auto &job : running_) status.push_back(MakeStatus(*job));
+        for (auto &job : queued_) status.push_back(MakeStatus(*job));
+        status.insert(status.end(), finished_.rbegin(), finished_.rend());
+        return status;
+    }
+
+    QueryScheduler::JobStatus QueryScheduler::MakeStatus(const Job &job) {
+        return {job.id, job.state, job.query->EventsProcessed(), job.query->EventsSelected()};
+    }
+
+    void QueryScheduler::Finish(const std::shared_ptr<Job> &job, bool failed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed || job->query->Failed()) {
+            job->state = JobState::kFailed;
+        } else {
+            job->state = job->query->IsCancelled() ? JobState::kCancelled : JobState::kDone;
+        }
+        finished_.push_back(MakeStatus(*job));
+        if (finished_.size() > FINISHED_HISTORY) finished_.pop_front();
+        running_.erase(std::remove(running_.begin(), running_.end(), job), running_.end());
+    }
+
+    void QueryScheduler::RunnerLoop() {
+        while (true) {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                job_cv_.wait(lock, [this]() { return stop_ || !queued_.empty(); });
+                if (stop_) return;
+                job = queued_.front();
+                queued_.pop_front();
+                job->state = JobState::kRunning;
+                running_.push_back(job);
+            }
+            LOG_INFO("Starting job {} on {}", job->id, job->query->MonitorFile());
+            // A failed query must not take the runner, or the whole monitor, down with it
+            bool failed = false;
+            try {
+                job->query->Run();
+            } catch (const std::exception &e) {
+                LOG_ERROR("Job {} failed: {}", job->id, e.what());
+                failed = true;
+            } catch (...) {
+                LOG_ERROR("Job {} failed with an unknown exception", job->id);
+                failed = true;
+            }
+            Finish(job, failed);
+            LOG_INFO("Finished job {}", job->id);
+        }
+    }
+
+} // data_monitor
@@ -0,0 +1,91 @@
+//
+// Runs monitor queries in the background so commands are never blocked by a long query.
+//
+
+#ifndef QUERY_SCHEDULER_H
+#define QUERY_SCHEDULER_H
+
+#include "monitor_query.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace data_monitor {
+
+class QueryScheduler {
+public:
+
+    enum class JobState : uint8_t {
+        kQueued = 0,
+        kRunning = 1,
+        kDone = 2,
+        kCancelled = 3,
+        // The query threw or could not be answered, whatever it sent before stands
+        kFailed = 4
+    };
+
+    struct JobStatus {
+        uint32_t id;
+        JobState state;
+        size_t events_processed;
+        size_t events_selected;
+    };
+
+    // Queries beyond the concurrency limit wait in a FIFO queue
+    explicit QueryScheduler(size_t max_concurrent = 2);
+    ~QueryScheduler();
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    /**
+    *  Queue a query to run as soon as a runner is free.
+    *   @param [in] query:  The query, the scheduler takes ownership
+    * @return Job ID used to cancel or follow the query, never 0
+    */
+    uint32_t Submit(std::unique_ptr<MonitorQuery> query);
+
+    /**
+    *  Cancel a queued or running query. A running query stops at its next event.
+    *   @param [in] id:  Job ID from Submit
+    * @return False if the job is not queued or running
+    */
+    bool Cancel(uint32_t id);
+    void CancelAll();
+
+    // Active jobs followed by the most recently finished ones
+    std::vector<JobStatus> Status();
+
+private:
+
+    struct Job {
+        uint32_t id;
+        JobState state;
+        std::unique_ptr<MonitorQuery> query;
+    };
+
+    void RunnerLoop();
+    void Finish(const std::shared_ptr<Job> &job, bool failed);
+    static JobStatus MakeStatus(const Job &job);
+
+    // How many finished jobs Status() still reports
+    constexpr static size_t FINISHED_HISTORY = 16;
+
+    std::mutex mutex_;
+    std::condition_variable job_cv_;
+    std::deque<std::shared_ptr<Job>> queued_;
+    std::vector<std::shared_ptr<Job>> running_;
+    std::deque<JobStatus> finished_;
+    uint32_t next_id_ = 1;
+    bool stop_ = false;
+    std::vector<std::thread> runners_;
+
+};
+
+} // data_monitor
+
+#endif //QUERY_SCHEDULER_H
@@ -0,0 +1,52 @@
+//
+// Token bucket rate limiter for pacing metrics onto the downlink.
+//
+
+#include "rate_limiter.h"
+#include <algorithm>
+#include <thread>
+
+namespace data_monitor {
+
+    RateLimiter::RateLimiter(double bytes_per_s, double burst_bytes) :
+    bytes_per_s_(bytes_per_s),
+    burst_bytes_(burst_bytes),
+    tokens_(burst_bytes),
+    last_refill_(Clock::now())
+    {}
+
+    void RateLimiter::SetRate(double bytes_per_s, double burst_bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytes_per_s_ = bytes_per_s;
+        burst_bytes_ = burst_bytes;
+        tokens_ = std::min(tokens_, burst_bytes_);
+        last_refill_ = Clock::now();
+    }
+
+    void RateLimiter::Refill(Clock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+        tokens_ = std::min(burst_bytes_, tokens_ + elapsed * bytes_per_s_);
+        last_refill_ = now;
+    }
+
+    void RateLimiter::Acquire(size_t bytes) {
+        std::chrono::duration<double> wait{0};
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (bytes_per_s_ <= 0) return; // unlimited
+            Refill(Clock::now());
+            tokens_ -= static_cast<double>(bytes);
+            // In debt, sleep until the bucket is back to empty
+            if (tokens_ < 0) wait = std::chrono::duration<double>(-tokens_ / bytes_per_s_);
+        }
+        if (wait.count() > 0) std::this_thread::sleep_for(wait);
+    }
+
+    void RateLimiter::Charge(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bytes_per_s_ <= 0) return;
+        Refill(Clock::now());
+        tokens_ -= static_cast<double>(bytes);
+    }
+
+} // data_monitor
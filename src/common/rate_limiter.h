@@ -0,0 +1,54 @@
+//
+// Token bucket rate limiter for pacing metrics onto the downlink.
+//
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+namespace data_monitor {
+
+class RateLimiter {
+public:
+    /**
+    *  @param [in] bytes_per_s:  Sustained rate, 0 disables the limit
+    *  @param [in] burst_bytes:  Bucket size, how much can go out back to back after being idle
+    */
+    RateLimiter(double bytes_per_s, double burst_bytes);
+    ~RateLimiter() = default;
+
+    void SetRate(double bytes_per_s, double burst_bytes);
+    // SetRate can come from the command thread while queries read the rate
+    double Rate() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_per_s_;
+    }
+
+    /**
+    *  Block until the bytes fit in the budget. A request larger than the bucket is let
+    *  through and leaves the bucket in debt, so the average rate is still respected.
+    */
+    void Acquire(size_t bytes);
+    // Take the bytes without waiting, e.g. a command reply. Any debt is paid by the next Acquire.
+    void Charge(size_t bytes);
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    void Refill(Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    double bytes_per_s_;
+    double burst_bytes_;
+    double tokens_;
+    Clock::time_point last_refill_;
+
+};
+
+} // data_monitor
+
+#endif //RATE_LIMITER_H
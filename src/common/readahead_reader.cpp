@@ -0,0 +1,231 @@
+//
+// Asynchronous sequential reads of a file range through a few large aligned buffers.
+//
+
+#include "readahead_reader.h"
+#include "worker_pool.h"
+#include "logger.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+namespace data_monitor {
+
+namespace {
+
+    // Threads blocking in pread for every reader without a ring, more than two rarely helps one disk
+    constexpr size_t IO_THREADS = 2;
+
+    WorkerPool& IoPool() {
+        static WorkerPool pool(IO_THREADS);
+        return pool;
+    }
+
+    // Full read unless the file ends first, returns the bytes read or -errno
+    int64_t ReadFully(int fd, uint8_t *data, size_t length, uint64_t offset) {
+        size_t done = 0;
+        while (done < length) {
+            ssize_t n = pread(fd, data + done, length - done, static_cast<off_t>(offset + done));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return -errno;
+            }
+            if (n == 0) break;
+            done += static_cast<size_t>(n);
+        }
+        return static_cast<int64_t>(done);
+    }
+
+} // namespace
+
+    ReadaheadReader::ReadaheadReader(const ReadaheadOptions &options) : options_(options) {
+        options_.num_blocks = std::max<size_t>(options_.num_blocks, 2);
+        options_.block_bytes = std::max(ALIGNMENT, options_.block_bytes / ALIGNMENT * ALIGNMENT);
+        blocks_.resize(options_.num_blocks);
+    }
+
+    ReadaheadReader::~ReadaheadReader() {
+        Close();
+    }
+
+    bool ReadaheadReader::AllocateBlocks() {
+        for (auto &block : blocks_) {
+            block.data = static_cast<uint8_t*>(std::aligned_alloc(ALIGNMENT, options_.block_bytes));
+            if (block.data == nullptr) {
+                LOG_ERROR("Failed to allocate {} readahead blocks of {} B", blocks_.size(), options_.block_bytes);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ReadaheadReader::ReleaseBlocks() {
+        for (auto &block : blocks_) {
+            std::free(block.data);
+            block.data = nullptr;
+        }
+    }
+
+    bool ReadaheadReader::Open(const std::string &path, uint64_t offset, uint64_t length) {
+        Close();
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) return false;
+        // Only held while a file is open, an idle reader costs nothing
+        if (!AllocateBlocks()) {
+            Close();
+            return false;
+        }
+        struct stat st{};
+        if (fstat(fd_, &st) != 0) {
+            Close();
+            return false;
+        }
+        const auto file_size = static_cast<uint64_t>(st.st_size);
+        range_offset_ = std::min(offset, file_size);
+        end_offset_ = length > file_size - range_offset_ ? file_size : range_offset_ + length;
+        next_read_offset_ = range_offset_ - range_offset_ % ALIGNMENT;
+        next_block_ = 0;
+        block_with_consumer_ = false;
+        bytes_read_ = 0;
+        // Let the kernel read ahead hard on top of ours, the range is read once front to back
+        posix_fadvise(fd_, static_cast<off_t>(next_read_offset_), static_cast<off_t>(end_offset_ - next_read_offset_),
+                      POSIX_FADV_SEQUENTIAL);
+
+#ifdef MONITOR_HAVE_IO_URING
+        if (options_.use_io_uring && !ring_ready_) {
+            ring_ready_ = io_uring_queue_init(static_cast<unsigned>(blocks_.size()), &ring_, 0) == 0;
+            if (!ring_ready_) LOG_WARNING("io_uring unavailable, reading {} with pread threads", path);
+        }
+#endif
+        for (auto &block : blocks_) Submit(block);
+        return true;
+    }
+
+    void ReadaheadReader::Close() {
+        // The reads still in flight write into the blocks, let them land first
+        for (auto &block : blocks_) {
+            if (block.state == BlockState::kInFlight) Wait(block);
+            block.state = BlockState::kIdle;
+        }
+#ifdef MONITOR_HAVE_IO_URING
+        if (ring_ready_) io_uring_queue_exit(&ring_);
+        ring_ready_ = false;
+#endif
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        ReleaseBlocks();
+    }
+
+    const char* ReadaheadReader::Backend() const {
+#ifdef MONITOR_HAVE_IO_URING
+        if (ring_ready_) return "io_uring";
+#endif
+        return "pread";
+    }
+
+    uint64_t ReadaheadReader::NextOffset() const {
+        const Block &block = blocks_[next_block_];
+        return block.state == BlockState::kIdle ? end_offset_ : std::max(block.offset, range_offset_);
+    }
+
+    void ReadaheadReader::Submit(Block &block) {
+        if (next_read_offset_ >= end_offset_) {
+            block.state = BlockState::kIdle;
+            return;
+        }
+        block.offset = next_read_offset_;
+        block.length = static_cast<size_t>(std::min<uint64_t>(options_.block_bytes, end_offset_ - next_read_offset_));
+        block.result = 0;
+        block.state = BlockState::kInFlight;
+        next_read_offset_ += block.length;
+
+#ifdef MONITOR_HAVE_IO_URING
+        if (ring_ready_) {
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+            // Never more reads in flight than blocks, which is the ring size
+            if (sqe != nullptr) {
+                io_uring_prep_read(sqe, fd_, block.data, static_cast<unsigned>(block.length), block.offset);
+                io_uring_sqe_set_data(sqe, &block);
+                if (io_uring_submit(&ring_) == 1) return;
+            }
+            LOG_WARNING("io_uring submit failed, reading the block with pread");
+            block.result = 0;
+            FinishRead(block);
+            block.state = BlockState::kDone;
+            return;
+        }
+#endif
+        const int fd = fd_;
+        Block *target = &block;
+        block.read = IoPool().Submit([fd, target]() {
+            target->result = ReadFully(fd, target->data, target->length, target->offset);
+        });
+    }
+
+    bool ReadaheadReader::Wait(Block &block) {
+#ifdef MONITOR_HAVE_IO_URING
+        if (ring_ready_) {
+            // Completions can come back in any order, note each one until this block's arrives
+            while (block.state == BlockState::kInFlight) {
+                struct io_uring_cqe *cqe = nullptr;
+                int ret = io_uring_wait_cqe(&ring_, &cqe);
+                if (ret == -EINTR) continue;
+                if (ret < 0) {
+                    LOG_ERROR("io_uring wait failed: {}", ret);
+                    return false;
+                }
+                auto *done = static_cast<Block*>(io_uring_cqe_get_data(cqe));
+                done->result = cqe->res;
+                done->state = BlockState::kDone;
+                io_uring_cqe_seen(&ring_, cqe);
+            }
+            // Short reads are rare on regular files but allowed, finish them synchronously
+            FinishRead(block);
+            return block.result >= 0;
+        }
+#endif
+        if (block.state == BlockState::kInFlight) {
+            block.read.get();
+            block.state = BlockState::kDone;
+        }
+        return block.result >= 0;
+    }
+
+    void ReadaheadReader::FinishRead(Block &block) const {
+        if (block.result < 0 || static_cast<size_t>(block.result) >= block.length) return;
+        const auto done = static_cast<size_t>(block.result);
+        int64_t rest = ReadFully(fd_, block.data + done, block.length - done, block.offset + done);
+        block.result = rest < 0 ? rest : static_cast<int64_t>(done) + rest;
+    }
+
+    bool ReadaheadReader::Next(ConstSpan<uint8_t> &block, uint64_t &block_offset) {
+        if (fd_ < 0) return false;
+        // The consumer is done with the last block, reuse it for the read after the newest one
+        if (block_with_consumer_) {
+            Submit(blocks_[(next_block_ + blocks_.size() - 1) % blocks_.size()]);
+            block_with_consumer_ = false;
+        }
+        Block &next = blocks_[next_block_];
+        if (next.state == BlockState::kIdle) return false;
+        if (!Wait(next)) {
+            LOG_ERROR("Read failed at offset {}: {}", next.offset, -next.result);
+            next.state = BlockState::kIdle;
+            return false;
+        }
+        next_block_ = (next_block_ + 1) % blocks_.size();
+        block_with_consumer_ = true;
+        bytes_read_ += static_cast<uint64_t>(next.result);
+
+        // Only the requested range, the first read started at the aligned offset below it
+        uint64_t skip = next.offset < range_offset_ ? range_offset_ - next.offset : 0;
+        const auto valid = static_cast<uint64_t>(next.result);
+        skip = std::min(skip, valid);
+        block = ConstSpan<uint8_t>(next.data + skip, static_cast<size_t>(valid - skip));
+        block_offset = next.offset + skip;
+        return true;
+    }
+
+} // data_monitor
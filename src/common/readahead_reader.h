@@ -0,0 +1,123 @@
+//
+// Asynchronous sequential reads of a file range through a few large aligned buffers.
+//
+
+#ifndef READAHEAD_READER_H
+#define READAHEAD_READER_H
+
+#include "sample_span.h"
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#if defined(MONITOR_IO_URING) && __has_include(<liburing.h>)
+#include <liburing.h>
+#define MONITOR_HAVE_IO_URING 1
+#endif
+
+namespace data_monitor {
+
+    struct ReadaheadOptions {
+        size_t block_bytes = 4 * 1024 * 1024;
+        // Triple buffered, one block with the consumer while the next two are read
+        size_t num_blocks = 3;
+        // Falls back to the pread threads if the build has no liburing or the kernel refuses a ring
+        bool use_io_uring = true;
+    };
+
+/*
+ * Reads always run ahead of the consumer: Open queues every block, each Next waits for the
+ * oldest one only, and handing a block back queues the read after the newest. Reads go through
+ * the page cache, so streaming a range also warms it for a decoder that reads the file itself.
+ * The blocks only exist while a file is open, an idle or queued reader holds no buffers.
+ */
+class ReadaheadReader {
+public:
+    explicit ReadaheadReader(const ReadaheadOptions &options = ReadaheadOptions());
+    ~ReadaheadReader();
+
+    ReadaheadReader(const ReadaheadReader&) = delete;
+    ReadaheadReader& operator=(const ReadaheadReader&) = delete;
+
+    /**
+    *  Open a file and start reading a range of it.
+    *
+    *   @param [in] path:  File to read
+    *   @param [in] offset:  First byte of the range, reads start at the aligned offset below it
+    *   @param [in] length:  Range length, clamped to the end of the file
+    *
+    * @return  Returns true on success, false on failure.
+    */
+    bool Open(const std::string &path, uint64_t offset = 0, uint64_t length = WHOLE_FILE);
+    // Waits for the reads in flight and frees the blocks
+    void Close();
+
+    /**
+    *  The next block of the range in file order, waits for its read to finish.
+    *
+    *   @param [out] block:  The bytes, valid until the next call to Next or Close
+    *   @param [out] block_offset:  File offset of the first byte
+    *
+    * @return  False at the end of the range or on a read error.
+    */
+    bool Next(ConstSpan<uint8_t> &block, uint64_t &block_offset);
+
+    // "io_uring" or "pread", which path the reads of the open file take
+    const char* Backend() const;
+    bool IsOpen() const { return fd_ >= 0; }
+    // Start of the block the consumer will get next, e.g. to throttle against a consumer position
+    uint64_t NextOffset() const;
+    uint64_t BytesRead() const { return bytes_read_; }
+
+    constexpr static uint64_t WHOLE_FILE = UINT64_MAX;
+    constexpr static size_t ALIGNMENT = 4096;
+
+private:
+
+    enum class BlockState : uint8_t {
+        kIdle,
+        kInFlight,
+        kDone
+    };
+
+    struct Block {
+        uint8_t *data = nullptr;
+        uint64_t offset = 0;
+        size_t length = 0;
+        int64_t result = 0;
+        BlockState state = BlockState::kIdle;
+        std::future<void> read;
+    };
+
+    // The block buffers are allocated by Open and freed by Close
+    bool AllocateBlocks();
+    void ReleaseBlocks();
+    // Queue the read of the next planned range into the block, if any is left
+    void Submit(Block &block);
+    bool Wait(Block &block);
+    // Reads what a short or failed read left of the block, on the calling thread
+    void FinishRead(Block &block) const;
+
+    ReadaheadOptions options_;
+    std::vector<Block> blocks_;
+    int fd_ = -1;
+    // Requested start, the first block is trimmed to it
+    uint64_t range_offset_ = 0;
+    uint64_t next_read_offset_ = 0;
+    uint64_t end_offset_ = 0;
+    size_t next_block_ = 0;
+    bool block_with_consumer_ = false;
+    uint64_t bytes_read_ = 0;
+
+#ifdef MONITOR_HAVE_IO_URING
+    struct io_uring ring_{};
+    bool ring_ready_ = false;
+#endif
+
+};
+
+} // data_monitor
+
+#endif //READAHEAD_READER_H
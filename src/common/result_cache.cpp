@@ -0,0 +1,99 @@
+//
+// LRU cache of finished query results, repeated queries on a closed file are replayed from memory.
+//
+
+#include "result_cache.h"
+
+namespace data_monitor {
+
+    size_t ResultKeyHash::operator()(const ResultKey &key) const {
+        // FNV-1a over the fields, the keys are small and few so this is plenty
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        auto mix = [&hash](uint64_t value) {
+            for (size_t i = 0; i < sizeof(value); i++) {
+                hash ^= (value >> (8 * i)) & 0xFF;
+                hash *= 0x100000001b3ULL;
+            }
+        };
+        mix(key.query_type);
+        mix(key.run_number);
+        mix(key.file_number);
+        mix(key.event_arg);
+        mix(key.stride_arg);
+        mix(key.encoding);
+        mix(key.alg_mask);
+        mix(key.alg_format);
+        mix(key.file_size);
+        mix(static_cast<uint64_t>(key.file_mtime));
+        return static_cast<size_t>(hash);
+    }
+
+    ResultCache::ResultCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    std::shared_ptr<const CachedResult> ResultCache::Lookup(const ResultKey &key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto entry = entries_.find(key);
+        if (entry == entries_.end()) {
+            misses_++;
+            return nullptr;
+        }
+        hits_++;
+        lru_.splice(lru_.begin(), lru_, entry->second);
+        return entry->second->result;
+    }
+
+    void ResultCache::Insert(const ResultKey &key, CachedResult result) {
+        size_t bytes = ResultBytes(result) + sizeof(Entry);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bytes > max_bytes_) return;
+        // Two identical queries running at once both insert, keep the newer one
+        auto existing = entries_.find(key);
+        if (existing != entries_.end()) {
+            bytes_ -= existing->second->bytes;
+            lru_.erase(existing->second);
+            entries_.erase(existing);
+        }
+        lru_.push_front({key, std::make_shared<const CachedResult>(std::move(result)), bytes});
+        entries_[key] = lru_.begin();
+        bytes_ += bytes;
+        EvictToBudget();
+    }
+
+    void ResultCache::SetBudget(size_t max_bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_bytes_ = max_bytes;
+        EvictToBudget();
+    }
+
+    void ResultCache::Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        entries_.clear();
+        bytes_ = 0;
+    }
+
+    size_t ResultCache::Bytes() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    size_t ResultCache::NumEntries() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+    size_t ResultCache::ResultBytes(const CachedResult &result) {
+        size_t bytes = result.capacity() * sizeof(MetricBatch::Record);
+        for (const auto &record : result) bytes += record.payload.capacity() * sizeof(uint32_t);
+        return bytes;
+    }
+
+    void ResultCache::EvictToBudget() {
+        while (bytes_ > max_bytes_ && !lru_.empty()) {
+            bytes_ -= lru_.back().bytes;
+            entries_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    }
+
+} // data_monitor
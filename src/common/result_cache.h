@@ -0,0 +1,103 @@
+//
+// LRU cache of finished query results, repeated queries on a closed file are replayed from memory.
+//
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "metric_batch.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace data_monitor {
+
+    // Everything that changes what a query sends. The file size and mtime make a rewritten
+    // or still growing file miss rather than return stale metrics.
+    struct ResultKey {
+        uint32_t query_type = 0;
+        uint32_t run_number = 0;
+        uint32_t file_number = 0;
+        uint32_t event_arg = 0;   // number of events, or the event number
+        uint32_t stride_arg = 0;  // stride, or the random flag
+        uint32_t encoding = 0;    // batching and compression settings
+        uint32_t alg_mask = 0;    // algorithms a minimal query runs
+        uint32_t alg_format = 0;  // payload format of the algorithms' own metrics
+        uint64_t file_size = 0;
+        int64_t file_mtime = 0;
+
+        bool operator==(const ResultKey &other) const {
+            return query_type == other.query_type && run_number == other.run_number &&
+                   file_number == other.file_number && event_arg == other.event_arg &&
+                   stride_arg == other.stride_arg && encoding == other.encoding && alg_mask == other.alg_mask &&
+                   alg_format == other.alg_format &&
+                   file_size == other.file_size && file_mtime == other.file_mtime;
+        }
+    };
+
+    struct ResultKeyHash {
+        size_t operator()(const ResultKey &key) const;
+    };
+
+    // The metrics a query sent, in order, with their metric IDs
+    using CachedResult = std::vector<MetricBatch::Record>;
+
+class ResultCache {
+public:
+    explicit ResultCache(size_t max_bytes);
+    ~ResultCache() = default;
+
+    /**
+    *  Find the result of an earlier identical query, marks it most recently used.
+    *
+    * @return  Returns nullptr on a miss. The result is shared and never modified so it
+    *          stays valid after being evicted.
+    */
+    std::shared_ptr<const CachedResult> Lookup(const ResultKey &key);
+
+    /**
+    *  Store a finished result, evicting the least recently used ones to stay in budget.
+    *  A result bigger than the whole budget is not stored.
+    */
+    void Insert(const ResultKey &key, CachedResult result);
+
+    // 0 disables the cache and drops everything in it
+    void SetBudget(size_t max_bytes);
+    void Clear();
+
+    size_t Bytes();
+    size_t NumEntries();
+    size_t Hits() const { return hits_.load(); }
+    size_t Misses() const { return misses_.load(); }
+
+    static size_t ResultBytes(const CachedResult &result);
+
+private:
+
+    struct Entry {
+        ResultKey key;
+        std::shared_ptr<const CachedResult> result;
+        size_t bytes;
+    };
+
+    void EvictToBudget();
+
+    std::mutex mutex_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    // Front is the most recently used
+    std::list<Entry> lru_;
+    std::unordered_map<ResultKey, std::list<Entry>::iterator, ResultKeyHash> entries_;
+
+};
+
+} // data_monitor
+
+#endif //RESULT_CACHE_H
@@ -0,0 +1,65 @@
+//
+// Bounded lock-free single producer, single consumer ring buffer.
+//
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace data_monitor {
+
+/*
+ * One thread may Push and one other thread may Pop, neither ever blocks. The head and tail
+ * live on separate cache lines so the two threads don't false share. Capacity must be a power
+ * of two, and it holds Capacity - 1 elements at most.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side, returns false if full
+    bool Push(const T &value) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & MASK;
+        if (next == head_.load(std::memory_order_acquire)) return false;
+        buffer_[tail] = value;
+        tail_.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, returns false if empty
+    bool Pop(T &value) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) return false;
+        value = buffer_[head];
+        head_.store((head + 1) & MASK, std::memory_order_release);
+        return true;
+    }
+
+    bool Empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+private:
+
+    constexpr static size_t MASK = Capacity - 1;
+    constexpr static size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0};
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0};
+    alignas(CACHE_LINE) std::array<T, Capacity> buffer_{};
+
+};
+
+} // data_monitor
+
+#endif //SPSC_QUEUE_H
@@ -0,0 +1,187 @@
+//
+// Per-event minimal summary partials kept between queries, so a query only decodes the events it hasn't seen.
+//
+
+#include "summary_store.h"
+#include "event_index.h"
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+
+namespace data_monitor {
+
+namespace {
+
+    void PutVarint(uint64_t value, std::vector<uint8_t> &out) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint64_t GetVarint(const uint8_t *&ptr) {
+        uint64_t value = 0;
+        for (unsigned shift = 0; ; shift += 7) {
+            const uint8_t byte = *ptr++;
+            value |= uint64_t{byte & 0x7Fu} << shift;
+            if ((byte & 0x80) == 0) return value;
+        }
+    }
+
+    // Each algorithm's partial is packed as its own words, so a new algorithm only has to keep
+    // its partial a plain block of integers
+    template <typename Partial>
+    constexpr void CheckPackable() {
+        static_assert(std::is_trivially_copyable_v<Partial>, "Stored partials must be trivially copyable");
+        static_assert(sizeof(Partial) % sizeof(uint64_t) == 0, "Stored partials must be whole 64b words");
+    }
+
+} // namespace
+
+    void CompactPartial::Pack(const EventPartial &partial) {
+        bytes_.clear();
+        std::apply([&](const auto &... alg_partials) {
+            ([&](const auto &alg_partial) {
+                CheckPackable<std::decay_t<decltype(alg_partial)>>();
+                const size_t num_words = sizeof(alg_partial) / sizeof(uint64_t);
+                const auto *raw = reinterpret_cast<const uint8_t*>(&alg_partial);
+                size_t last = 0;
+                for (size_t i = 0; i < num_words; i++) {
+                    uint64_t word;
+                    std::memcpy(&word, raw + i * sizeof(word), sizeof(word));
+                    if (word == 0) continue;
+                    // Deltas are offset by one so 0 can end the partial
+                    PutVarint(i - last + 1, bytes_);
+                    PutVarint(word, bytes_);
+                    last = i;
+                }
+                bytes_.push_back(0);
+            }(alg_partials), ...);
+        }, partial);
+        bytes_.shrink_to_fit();
+    }
+
+    void CompactPartial::Unpack(EventPartial &partial) const {
+        const uint8_t *ptr = bytes_.data();
+        std::apply([&](auto &... alg_partials) {
+            ([&](auto &alg_partial) {
+                auto *raw = reinterpret_cast<uint8_t*>(&alg_partial);
+                std::memset(raw, 0, sizeof(alg_partial));
+                size_t index = 0;
+                for (uint64_t delta = GetVarint(ptr); delta != 0; delta = GetVarint(ptr)) {
+                    index += delta - 1;
+                    const uint64_t word = GetVarint(ptr);
+                    std::memcpy(raw + index * sizeof(word), &word, sizeof(word));
+                }
+            }(alg_partials), ...);
+        }, partial);
+    }
+
+    void CompactPartial::MergeInto(EventPartial &summary, EventPartial &scratch) const {
+        Unpack(scratch);
+        MinimalPipeline::Merge(summary, scratch);
+    }
+
+    bool FileVersion::Stat(const std::string &data_file, FileVersion &version) {
+        version.path = data_file;
+        return EventIndex::FileStat(data_file, version.size, version.mtime);
+    }
+
+    SummaryStore::SummaryStore(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    SummaryStore::FileEntry* SummaryStore::Find(const FileVersion &file) {
+        auto entry = files_.find(file.path);
+        if (entry == files_.end()) return nullptr;
+        if (!(entry->second->version == file)) {
+            // The file changed since these events were summarized
+            Erase(entry->second);
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, entry->second);
+        return &lru_.front();
+    }
+
+    size_t SummaryStore::MergeStored(const FileVersion &file, const std::vector<size_t> &events,
+                                     EventPartial &summary, std::vector<size_t> &missing) {
+        missing.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        FileEntry *entry = Find(file);
+        if (entry == nullptr) {
+            missing = events;
+            return 0;
+        }
+        size_t num_merged = 0;
+        for (auto evt : events) {
+            auto stored = entry->events.find(evt);
+            if (stored == entry->events.end()) {
+                missing.push_back(evt);
+                continue;
+            }
+            stored->second.MergeInto(summary, scratch_);
+            num_merged++;
+        }
+        return num_merged;
+    }
+
+    void SummaryStore::Insert(const FileVersion &file, EventPartials &partials) {
+        if (partials.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (max_bytes_ == 0) return;
+        FileEntry *entry = Find(file);
+        if (entry == nullptr) {
+            lru_.push_front({file, {}, 0});
+            files_[file.path] = lru_.begin();
+            entry = &lru_.front();
+        }
+        for (auto &partial : partials) {
+            const size_t bytes = partial.second.Bytes() + EVENT_OVERHEAD_BYTES;
+            // Older files make room first, this file is the one being asked about
+            while (bytes_ + bytes > max_bytes_ && lru_.size() > 1) Erase(std::prev(lru_.end()));
+            if (bytes_ + bytes > max_bytes_) break;
+            // Another query may have decoded the same event, the partials are identical
+            if (entry->events.emplace(partial.first, std::move(partial.second)).second) {
+                num_events_++;
+                entry->bytes += bytes;
+                bytes_ += bytes;
+            }
+        }
+    }
+
+    void SummaryStore::SetBudget(size_t max_bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_bytes_ = max_bytes;
+        EvictToBudget();
+    }
+
+    void SummaryStore::Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lru_.clear();
+        files_.clear();
+        num_events_ = 0;
+        bytes_ = 0;
+    }
+
+    size_t SummaryStore::Bytes() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    size_t SummaryStore::NumEvents() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return num_events_;
+    }
+
+    void SummaryStore::EvictToBudget() {
+        // Whole files go at once, a query on a file wants all of its stored events
+        while (bytes_ > max_bytes_ && !lru_.empty()) Erase(std::prev(lru_.end()));
+    }
+
+    void SummaryStore::Erase(FileList::iterator entry) {
+        num_events_ -= entry->events.size();
+        bytes_ -= entry->bytes;
+        files_.erase(entry->version.path);
+        lru_.erase(entry);
+    }
+
+} // data_monitor
@@ -0,0 +1,121 @@
+//
+// Per-event minimal summary partials kept between queries, so a query only decodes the events it hasn't seen.
+//
+
+#ifndef SUMMARY_STORE_H
+#define SUMMARY_STORE_H
+
+#include "monitor_pipeline.h"
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace data_monitor {
+
+    // One version of a data file, a rewritten or growing file is a different version
+    struct FileVersion {
+        std::string path;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+
+        static bool Stat(const std::string &data_file, FileVersion &version);
+        bool operator==(const FileVersion &other) const {
+            return path == other.path && size == other.size && mtime == other.mtime;
+        }
+    };
+
+    // The minimal summary contribution of a single event, one partial per pipeline algorithm
+    using EventPartial = MinimalPipeline::Partials;
+
+/*
+ * One event's partial packed for keeping, the full partial is tens of KB once the histogram,
+ * hit and pulse sums are in it. A single event leaves most of those words zero and its sums
+ * are small, so only the nonzero 64b words are kept as varint (index delta, value) pairs.
+ * Unpacking gives back the exact partial, whatever the algorithms put in it.
+ */
+class CompactPartial {
+public:
+    CompactPartial() = default;
+    explicit CompactPartial(const EventPartial &partial) { Pack(partial); }
+
+    void Pack(const EventPartial &partial);
+    void Unpack(EventPartial &partial) const;
+    // Unpacks into scratch, then merges
+    void MergeInto(EventPartial &summary, EventPartial &scratch) const;
+
+    size_t Bytes() const { return bytes_.size(); }
+
+private:
+
+    std::vector<uint8_t> bytes_;
+
+};
+
+    using EventPartials = std::vector<std::pair<size_t, CompactPartial>>;
+
+class SummaryStore {
+public:
+    explicit SummaryStore(size_t max_bytes);
+    ~SummaryStore() = default;
+
+    /**
+    *  Merge the stored partials of the wanted events into the summaries.
+    *
+    *   @param [in] file:  Data file version, a stale version is dropped
+    *   @param [in] events:  Event numbers the query wants
+    *   @param [out] summary:  Partials the stored events are merged into
+    *   @param [out] missing:  The wanted events with nothing stored, these still need decoding
+    *
+    * @return  Number of events merged from the store
+    */
+    size_t MergeStored(const FileVersion &file, const std::vector<size_t> &events,
+                       EventPartial &summary, std::vector<size_t> &missing);
+
+    // Keep newly decoded events, evicting the least recently used files to stay in budget. Once
+    // only this file is left and the budget is still used up, the rest of the events are dropped.
+    void Insert(const FileVersion &file, EventPartials &partials);
+
+    // 0 disables the store and drops everything in it
+    void SetBudget(size_t max_bytes);
+    void Clear();
+
+    size_t Bytes();
+    size_t NumEvents();
+
+    // Map node, event number and vector on top of each event's packed bytes
+    constexpr static size_t EVENT_OVERHEAD_BYTES = 64;
+
+private:
+
+    struct FileEntry {
+        FileVersion version;
+        std::unordered_map<size_t, CompactPartial> events;
+        size_t bytes = 0;
+    };
+    using FileList = std::list<FileEntry>;
+
+    // Finds the file and marks it most recently used, nullptr if missing or stale
+    FileEntry* Find(const FileVersion &file);
+    void EvictToBudget();
+    void Erase(FileList::iterator entry);
+
+    std::mutex mutex_;
+    size_t max_bytes_;
+    size_t num_events_ = 0;
+    size_t bytes_ = 0;
+    // Unpacking space for the merges, only used under the mutex
+    EventPartial scratch_;
+    // Front is the most recently used
+    FileList lru_;
+    std::unordered_map<std::string, FileList::iterator> files_;
+
+};
+
+} // data_monitor
+
+#endif //SUMMARY_STORE_H
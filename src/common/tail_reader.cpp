@@ -0,0 +1,70 @@
+//
+// Follows a readout file while it is being written and counts the events that are complete.
+//
+
+#include "tail_reader.h"
+#include "event_index.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace data_monitor {
+
+    TailReader::~TailReader() {
+        Close();
+    }
+
+    bool TailReader::Open(const std::string &path) {
+        Close();
+        fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) return false;
+        path_ = path;
+        buffer_.resize(READ_WORDS);
+        return true;
+    }
+
+    void TailReader::Close() {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        path_.clear();
+        Reset();
+    }
+
+    void TailReader::Reset() {
+        scan_offset_ = 0;
+        in_event_ = false;
+        num_complete_ = 0;
+    }
+
+    size_t TailReader::Poll() {
+        if (fd_ < 0) return 0;
+        struct stat st{};
+        if (fstat(fd_, &st) != 0) return 0;
+        auto file_size = static_cast<uint64_t>(st.st_size);
+        // Truncated or rewritten, start over
+        if (file_size < scan_offset_) Reset();
+
+        size_t num_before = num_complete_;
+        // Whole words only, the last one may still be half written
+        while (file_size - scan_offset_ >= sizeof(uint32_t)) {
+            size_t bytes = std::min<uint64_t>(READ_WORDS * sizeof(uint32_t), file_size - scan_offset_);
+            bytes -= bytes % sizeof(uint32_t);
+            ssize_t num_read = pread(fd_, buffer_.data(), bytes, static_cast<off_t>(scan_offset_));
+            if (num_read < static_cast<ssize_t>(sizeof(uint32_t))) break;
+            size_t num_words = static_cast<size_t>(num_read) / sizeof(uint32_t);
+            // Same framing as the event index
+            for (size_t i = 0; i < num_words; i++) {
+                if (buffer_[i] == EVENT_START_WORD) {
+                    in_event_ = true;
+                } else if (buffer_[i] == EVENT_END_WORD && in_event_) {
+                    num_complete_++;
+                    in_event_ = false;
+                }
+            }
+            scan_offset_ += num_words * sizeof(uint32_t);
+        }
+        return num_complete_ - num_before;
+    }
+
+} // data_monitor
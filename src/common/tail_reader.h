@@ -0,0 +1,58 @@
+//
+// Follows a readout file while it is being written and counts the events that are complete.
+//
+
+#ifndef TAIL_READER_H
+#define TAIL_READER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace data_monitor {
+
+class TailReader {
+public:
+    TailReader() = default;
+    ~TailReader();
+
+    TailReader(const TailReader&) = delete;
+    TailReader& operator=(const TailReader&) = delete;
+
+    bool Open(const std::string &path);
+    void Close();
+
+    /**
+    *  Scan only the bytes written since the last call for the event start/end words.
+    *  An event counts once its end word is on disk, a half written event is picked up
+    *  by a later call.
+    *
+    * @return  Number of events completed since the last call
+    */
+    size_t Poll();
+
+    bool IsOpen() const { return fd_ >= 0; }
+    const std::string& Path() const { return path_; }
+    size_t NumComplete() const { return num_complete_; }
+    uint64_t ScannedBytes() const { return scan_offset_; }
+
+private:
+
+    void Reset();
+
+    // Words per read, the file grows by a few events between polls
+    constexpr static size_t READ_WORDS = 64 * 1024;
+
+    int fd_ = -1;
+    std::string path_;
+    uint64_t scan_offset_ = 0;
+    bool in_event_ = false;
+    size_t num_complete_ = 0;
+    std::vector<uint32_t> buffer_;
+
+};
+
+} // data_monitor
+
+#endif //TAIL_READER_H
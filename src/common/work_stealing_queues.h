@@ -0,0 +1,84 @@
+//
+// Per-worker task queues where an idle worker takes work from the back of another's queue.
+//
+
+#ifndef WORK_STEALING_QUEUES_H
+#define WORK_STEALING_QUEUES_H
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace data_monitor {
+
+/*
+ * Meant for coarse tasks, e.g. a chunk of a file's events, so a mutex per queue costs nothing
+ * next to the task. The owner pops from the front and keeps walking its work in order, a thief
+ * takes from the back so it lands on work the owner would have reached last. Queues are filled
+ * before the workers start, a worker is done once every queue is empty.
+ */
+template <typename T>
+class WorkStealingQueues {
+public:
+    explicit WorkStealingQueues(size_t num_queues) : queues_(num_queues == 0 ? 1 : num_queues) {}
+
+    WorkStealingQueues(const WorkStealingQueues&) = delete;
+    WorkStealingQueues& operator=(const WorkStealingQueues&) = delete;
+
+    void Push(size_t queue, T item) {
+        Queue &owner = queues_[queue % queues_.size()];
+        std::lock_guard<std::mutex> lock(owner.mutex);
+        owner.items.push_back(std::move(item));
+    }
+
+    /**
+    *  Next task for a worker, its own queue first then the others starting with its neighbour.
+    *   @param [in] queue:  The worker's own queue
+    *   @param [out] item:  The task
+    * @return  False once there is nothing left anywhere
+    */
+    bool Pop(size_t queue, T &item) {
+        const size_t own = queue % queues_.size();
+        {
+            Queue &owner = queues_[own];
+            std::lock_guard<std::mutex> lock(owner.mutex);
+            if (!owner.items.empty()) {
+                item = std::move(owner.items.front());
+                owner.items.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); i++) {
+            Queue &victim = queues_[(own + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.items.empty()) continue;
+            item = std::move(victim.items.back());
+            victim.items.pop_back();
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    size_t NumQueues() const { return queues_.size(); }
+    // Tasks taken from another worker's queue
+    size_t Steals() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<T> items;
+    };
+
+    std::vector<Queue> queues_;
+    std::atomic<size_t> steals_{0};
+
+};
+
+} // data_monitor
+
+#endif //WORK_STEALING_QUEUES_H
@@ -0,0 +1,70 @@
+//
+// Fixed size pool of worker threads for splitting a query across cores.
+//
+
+#include "worker_pool.h"
+#include <memory>
+
+namespace data_monitor {
+
+    WorkerPool::WorkerPool(size_t num_workers) {
+        if (num_workers == 0) num_workers = std::thread::hardware_concurrency();
+        if (num_workers == 0) num_workers = 1; // hardware_concurrency can't always tell
+        for (size_t i = 0; i < num_workers; i++) {
+            workers_.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        task_cv_.notify_all();
+        for (auto &worker : workers_) worker.join();
+    }
+
+    std::future<void> WorkerPool::Submit(std::function<void()> task) {
+        // std::function needs a copyable target so share the packaged task
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        std::future<void> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push([packaged]() { (*packaged)(); });
+            num_pending_++;
+        }
+        task_cv_.notify_one();
+        return result;
+    }
+
+    void WorkerPool::GetAll(std::vector<std::future<void>> &futures) {
+        for (auto &future : futures) future.wait();
+        for (auto &future : futures) future.get();
+    }
+
+    void WorkerPool::Wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this]() { return num_pending_ == 0; });
+    }
+
+    void WorkerPool::WorkerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                task_cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                // Drain the queue before stopping so Wait() never hangs
+                if (stop_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                num_pending_--;
+            }
+            done_cv_.notify_all();
+        }
+    }
+
+} // data_monitor
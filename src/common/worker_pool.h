@@ -0,0 +1,53 @@
+//
+// Fixed size pool of worker threads for splitting a query across cores.
+//
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace data_monitor {
+
+class WorkerPool {
+public:
+    // 0 workers means one per hardware thread
+    explicit WorkerPool(size_t num_workers = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // The future is ready once this task has run, for callers sharing the pool
+    std::future<void> Submit(std::function<void()> task);
+    // Wait for every task before getting any, so the first exception thrown by one of them is
+    // rethrown only once none are still using the caller's state
+    static void GetAll(std::vector<std::future<void>> &futures);
+    // Block until every submitted task has finished
+    void Wait();
+    size_t NumWorkers() const { return workers_.size(); }
+
+private:
+
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable task_cv_;
+    std::condition_variable done_cv_;
+    size_t num_pending_ = 0;
+    bool stop_ = false;
+
+};
+
+} // data_monitor
+
+#endif //WORKER_POOL_H
@@ -0,0 +1,53 @@
+//
+// Charge ADC amplitude spectra, per channel group histograms with power of two bins.
+//
+
+#include "adc_histogram.h"
+#include "simd_kernels.h"
+
+void AdcHistogram::Merge(const AdcHistogram &other) {
+    for (size_t i = 0; i < counts.size(); i++) counts[i] += other.counts[i];
+    num_events += other.num_events;
+}
+
+void AdcHistogram::Subtract(const AdcHistogram &other) {
+    for (size_t i = 0; i < counts.size(); i++) counts[i] -= other.counts[i];
+    num_events -= other.num_events;
+}
+
+void AdcHistogramAlg::ProcessEvent(const FlatEvent &event, Partial &partial) const {
+    for (size_t i = 0; i < event.NumChargeChannels(); i++) {
+        uint16_t channel = event.ChargeChannel(i);
+        if (channel > NUM_CHARGE_CHANNELS-1) continue;
+        kernels::Histogram(event.ChargeSamples(i), AdcHistogram::BIN_SHIFT,
+                           partial.Group(channel >> AdcHistogram::GROUP_SHIFT), AdcHistogram::NUM_BINS);
+    }
+    partial.num_events++;
+}
+
+void AdcHistogramAlg::SerializeMetrics(const Partial &partial, const MetricHeader &header, std::vector<AlgMetric> &out) const {
+    out.push_back({ADC_HISTOGRAM_METRIC, {}});
+    std::vector<uint32_t> &payload = out.back().payload;
+    payload.reserve(6 + partial.counts.size());
+    payload.push_back(header.run_number);
+    payload.push_back(header.file_number);
+    payload.push_back(header.evt_number);
+    payload.push_back(static_cast<uint32_t>(partial.num_events));
+    payload.push_back(static_cast<uint32_t>(format_) << 24 | uint32_t{AdcHistogram::BIN_SHIFT} << 16 |
+                      uint32_t{AdcHistogram::GROUP_SHIFT} << 8);
+    payload.push_back(static_cast<uint32_t>(AdcHistogram::NUM_GROUPS << 16 | AdcHistogram::NUM_BINS));
+
+    if (format_ == HistogramFormat::kDense) {
+        payload.insert(payload.end(), partial.counts.begin(), partial.counts.end());
+        return;
+    }
+    // Most of a group's samples are on the baseline so only a few bins are ever filled
+    for (size_t group = 0; group < AdcHistogram::NUM_GROUPS; group++) {
+        const uint32_t *bins = partial.Group(group);
+        for (size_t bin = 0; bin < AdcHistogram::NUM_BINS; bin++) {
+            if (bins[bin] == 0) continue;
+            payload.push_back(static_cast<uint32_t>(group << 16 | bin));
+            payload.push_back(bins[bin]);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+//
+// Charge ADC amplitude spectra, per channel group histograms with power of two bins.
+//
+
+#ifndef ADC_HISTOGRAM_H
+#define ADC_HISTOGRAM_H
+
+#include "monitor_algs_base.hpp"
+#include "process_events.h"
+#include "flat_event.h"
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Counts per bin of every charge sample, summed over a group of neighbouring channels so a
+ * partial stays small enough to keep one per event in the summary store. Plain counts so
+ * partials merge exactly in any order.
+ */
+struct AdcHistogram {
+    // 12b ADC in bins of 32 counts, groups of 8 channels
+    constexpr static uint8_t BIN_SHIFT = 5;
+    constexpr static uint8_t GROUP_SHIFT = 3;
+    constexpr static size_t NUM_BINS = 4096 >> BIN_SHIFT;
+    constexpr static size_t NUM_GROUPS = (NUM_CHARGE_CHANNELS + (1 << GROUP_SHIFT) - 1) >> GROUP_SHIFT;
+
+    std::array<uint32_t, NUM_GROUPS * NUM_BINS> counts{0};
+    size_t num_events = 0;
+
+    uint32_t* Group(size_t group) { return counts.data() + group * NUM_BINS; }
+    const uint32_t* Group(size_t group) const { return counts.data() + group * NUM_BINS; }
+
+    void Merge(const AdcHistogram &other);
+    void Subtract(const AdcHistogram &other);
+    void Clear() { *this = AdcHistogram(); }
+};
+
+// Payload layout of the histogram metric, selected by command
+enum class HistogramFormat : uint8_t {
+    kDense = 0,   // every bin of every group
+    kSparse = 1   // only the filled bins, as (group << 16 | bin, count) pairs
+};
+
+class AdcHistogramAlg : public MonitorAlgBase<AdcHistogramAlg, AdcHistogram> {
+public:
+    constexpr static uint32_t ALG_ID = 0x4;
+    constexpr static uint32_t ADC_HISTOGRAM_METRIC = 0x400A;
+
+    void ProcessEvent(const FlatEvent &event, Partial &partial) const;
+
+    /**
+    *  Payload, all 32b words:
+    *   [0-2]  run, file, event
+    *   [3]    number of events summed
+    *   [4]    format << 24 | BIN_SHIFT << 16 | GROUP_SHIFT << 8
+    *   [5]    NUM_GROUPS << 16 | NUM_BINS
+    *   then the counts in the selected format.
+    */
+    void SerializeMetrics(const Partial &partial, const MetricHeader &header, std::vector<AlgMetric> &out) const;
+
+    void SetFormat(HistogramFormat format) { format_ = format; }
+    HistogramFormat Format() const { return format_; }
+
+private:
+    HistogramFormat format_ = HistogramFormat::kSparse;
+};
+
+#endif //ADC_HISTOGRAM_H
@@ -0,0 +1,99 @@
+//
+// Statically composed set of monitoring algorithms, see monitor_algs_base.hpp for the interface.
+//
+
+#ifndef ALG_PIPELINE_H
+#define ALG_PIPELINE_H
+
+#include "monitor_algs_base.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+
+/*
+ * Every call expands to a direct call into each algorithm in order, the only runtime choice
+ * is one mask test per algorithm per event. The partials of all algorithms travel together
+ * as a tuple so slices, stored events and rolling windows handle them as one value.
+ */
+template <typename... Algs>
+class AlgPipeline {
+public:
+
+    using Partials = std::tuple<typename Algs::Partial...>;
+
+    // Every algorithm in the pipeline selected
+    constexpr static uint32_t ALL_ALGS = (Algs::ALG_ID | ...);
+
+    AlgPipeline() = default;
+    explicit AlgPipeline(Algs... algs) : algs_(std::move(algs)...) {}
+
+    /**
+    *  Run the selected algorithms on one event.
+    *   @param [in] event:  The decoded event
+    *   @param [out] partials:  Accumulated into, one per thread or event
+    *   @param [in] alg_mask:  OR of the ALG_IDs to run
+    */
+    void ProcessEvent(const FlatEvent &event, Partials &partials, uint32_t alg_mask = ALL_ALGS) const {
+        ForEach([&](const auto &alg, auto &partial) {
+            if (alg_mask & alg.ALG_ID) alg.ProcessEvent(event, partial);
+        }, partials);
+    }
+
+    void UpdateMetrics(const Partials &partials, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics,
+                       uint32_t alg_mask = ALL_ALGS) const {
+        ForEach([&](const auto &alg, const auto &partial) {
+            if (alg_mask & alg.ALG_ID) alg.UpdateMetrics(partial, lbw_metrics, metrics);
+        }, partials);
+    }
+
+    void SerializeMetrics(const Partials &partials, const MetricHeader &header, std::vector<AlgMetric> &out,
+                          uint32_t alg_mask = ALL_ALGS) const {
+        ForEach([&](const auto &alg, const auto &partial) {
+            if (alg_mask & alg.ALG_ID) alg.SerializeMetrics(partial, header, out);
+        }, partials);
+    }
+
+    static void Merge(Partials &partials, const Partials &other) {
+        MergeImpl(partials, other, std::index_sequence_for<Algs...>());
+    }
+    static void Subtract(Partials &partials, const Partials &other) {
+        SubtractImpl(partials, other, std::index_sequence_for<Algs...>());
+    }
+    static void Clear(Partials &partials) {
+        ClearImpl(partials, std::index_sequence_for<Algs...>());
+    }
+
+    // Per algorithm configuration, e.g. attaching running stats
+    template <typename Alg>
+    Alg& Get() { return std::get<Alg>(algs_); }
+
+private:
+
+    template <typename Fn, typename PartialsT>
+    void ForEach(Fn &&fn, PartialsT &partials) const {
+        ForEachImpl(fn, partials, std::index_sequence_for<Algs...>());
+    }
+    template <typename Fn, typename PartialsT, size_t... I>
+    void ForEachImpl(Fn &fn, PartialsT &partials, std::index_sequence<I...>) const {
+        (fn(std::get<I>(algs_), std::get<I>(partials)), ...);
+    }
+    template <size_t... I>
+    static void MergeImpl(Partials &partials, const Partials &other, std::index_sequence<I...>) {
+        (Algs::Merge(std::get<I>(partials), std::get<I>(other)), ...);
+    }
+    template <size_t... I>
+    static void SubtractImpl(Partials &partials, const Partials &other, std::index_sequence<I...>) {
+        (Algs::Subtract(std::get<I>(partials), std::get<I>(other)), ...);
+    }
+    // By index like the others, two algorithms may share a partial type
+    template <size_t... I>
+    static void ClearImpl(Partials &partials, std::index_sequence<I...>) {
+        (Algs::Clear(std::get<I>(partials)), ...);
+    }
+
+    std::tuple<Algs...> algs_;
+
+};
+
+#endif //ALG_PIPELINE_H
@@ -0,0 +1,59 @@
+//
+// Charge channels and light channels a query uses, the others are left out of its flat events.
+//
+
+#ifndef CHANNEL_SELECTION_H
+#define CHANNEL_SELECTION_H
+
+#include "tpc_monitor.h"
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Defaults to everything, which also keeps channel numbers outside the known range so a full
+ * selection never changes what an event holds. A query that only sends a few waveforms clears the
+ * selection and adds them before decoding.
+ *
+ * The readout decoder always unpacks the whole EventStruct, the selection only trims what is
+ * copied into the FlatEvent and what the algorithms then run over. Decoders that can step over
+ * a waveform by its header, like the synthetic one in the benchmarks, can take it too.
+ */
+class ChannelSelection {
+public:
+    ChannelSelection() = default;
+
+    static const ChannelSelection& All() {
+        static const ChannelSelection all;
+        return all;
+    }
+
+    // Nothing selected, charge and light are then added channel by channel
+    void Clear() {
+        charge_.reset();
+        light_.reset();
+        all_charge_ = false;
+        all_light_ = false;
+    }
+    // Channels outside the known range can't be selected on their own
+    void SelectCharge(size_t channel) { if (channel < NUM_CHARGE_CHANNELS) charge_.set(channel); }
+    void SelectLight(size_t channel) { if (channel < NUM_LIGHT_CHANNELS) light_.set(channel); }
+    void SelectAllCharge() { all_charge_ = true; }
+    void SelectAllLight() { all_light_ = true; }
+
+    bool Charge(uint16_t channel) const { return all_charge_ || (channel < NUM_CHARGE_CHANNELS && charge_.test(channel)); }
+    bool Light(uint16_t channel) const { return all_light_ || (channel < NUM_LIGHT_CHANNELS && light_.test(channel)); }
+    bool AllCharge() const { return all_charge_; }
+    bool AllLight() const { return all_light_; }
+    size_t NumCharge() const { return all_charge_ ? NUM_CHARGE_CHANNELS : charge_.count(); }
+
+private:
+
+    std::bitset<NUM_CHARGE_CHANNELS> charge_;
+    std::bitset<NUM_LIGHT_CHANNELS> light_;
+    bool all_charge_ = true;
+    bool all_light_ = true;
+
+};
+
+#endif //CHANNEL_SELECTION_H
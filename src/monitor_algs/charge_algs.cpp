@@ -3,6 +3,9 @@
 //
 
 #include "charge_algs.h"
+#include "simd_kernels.h"
+#include "waveform_codec.h"
+#include "logger.h"
 
 #include <cmath>
 #include <numeric>
@@ -13,63 +16,103 @@
 //    return true;
 //}
 
-void ChargeAlgs::MinimalSummary(EventStruct &event) {
+void ChargeSummary::Merge(const ChargeSummary &other) {
+    for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
+        baseline[i] += other.baseline[i];
+        variance[i] += other.variance[i];
+        charge_hits[i] += other.charge_hits[i];
+    }
+    num_events += other.num_events;
+}
 
-    for (const auto &channel : event.charge_channel) {
-        BaselineRms(event.charge_adc.at(channel), channel);
-        HitsAboveThreshold(event.charge_adc.at(channel), channel); // needs to always follow baseline & RMS
+void ChargeSummary::Subtract(const ChargeSummary &other) {
+    for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
+        baseline[i] -= other.baseline[i];
+        variance[i] -= other.variance[i];
+        charge_hits[i] -= other.charge_hits[i];
     }
-    num_events_++;
+    num_events -= other.num_events;
 }
 
-void ChargeAlgs::BaselineRms(const std::vector<uint16_t> &channel_charge_words, uint16_t channel) {
-    // Calculate the baseline and RMS for the channel, only use the first 5 samples
-    double num_samples = 10;
+void ChargeAlgs::MinimalSummary(const EventStruct &event) {
 
-    double baseline_sum = 0;
-    for (size_t i = 0; i < num_samples; i++) { baseline_sum += channel_charge_words[i]; }
-    baseline_sum /= num_samples;
-    baseline_[channel] += baseline_sum;
+    for (size_t i = 0; i < event.charge_channel.size(); i++) {
+        uint16_t channel = event.charge_channel[i];
+        if (channel > NUM_CHARGE_CHANNELS-1) continue;
+        auto baseline = BaselineRms(event.charge_adc.at(i), channel, summary_, &running_stats_);
+        HitsAboveThreshold(event.charge_adc.at(i), channel, baseline, summary_); // needs to always follow baseline & RMS
+    }
+    running_stats_.EndEvent();
+    summary_.num_events++;
+}
 
-    // Use the averged baseline as it gives a better std. dev. estimate
-    double baseline_sub = baseline_[channel] / (num_events_ + 1);
-    double variance_sum = 0;
-    for (size_t i = 0; i < num_samples; i++) {
-        variance_sum += (channel_charge_words[i] - baseline_sub) * (channel_charge_words[i] - baseline_sub);
+template <typename Math>
+void ChargeAlgs::MinimalSummary(const FlatEvent &event, ChargeSummary &summary, ChargeStats *stats) {
+    // Channels are contiguous in the flat sample buffer so this walks memory front to back
+    for (size_t i = 0; i < event.NumChargeChannels(); i++) {
+        uint16_t channel = event.ChargeChannel(i);
+        if (channel > NUM_CHARGE_CHANNELS-1) continue;
+        auto baseline = BaselineRms(event.ChargeSamples(i), channel, summary, stats);
+        HitsAboveThreshold<Math>(event.ChargeSamples(i), channel, baseline, summary); // needs to always follow baseline & RMS
     }
-    variance_sum /= num_samples;
-    variance_[channel] += variance_sum;
+    if (stats != nullptr) stats->EndEvent();
+    summary.num_events++;
 }
 
-void ChargeAlgs::HitsAboveThreshold(const std::vector<uint16_t> &channel_charge_words, uint16_t channel) {
-    // Use baseline shifted threshold instead of baseline subtraction to avoid pesky 16b int overflows
-    double rms_threshold = 5.0;
-    double threshold = baseline_[channel] + rms_threshold * std::abs(variance_[channel]) + 1.0;
+kernels::SumSquares ChargeAlgs::BaselineRms(SampleSpan channel_charge_words, uint16_t channel, ChargeSummary &summary,
+                                            ChargeStats *stats) {
+    // Calculate the baseline and RMS for the channel, only use the first 10 samples
+    const SampleSpan baseline_words = channel_charge_words.subspan(0, BASELINE_SAMPLES);
+    const kernels::SumSquares moments = kernels::SumAndSumSquares(baseline_words);
+    const uint64_t num_samples = baseline_words.size();
+    if (num_samples == 0) return moments;
+
+    // The event baseline is sum x / n and the variance about it (n sum x^2 - (sum x)^2) / n^2,
+    // both exact integers once scaled so the summary can be merged in any order
+    summary.baseline[channel] += moments.sum * (ChargeSummary::MEAN_SCALE / num_samples);
+    summary.variance[channel] += (num_samples * moments.sum_sq - moments.sum * moments.sum)
+                                 * (ChargeSummary::VARIANCE_SCALE / (num_samples * num_samples));
+    if (stats != nullptr) stats->Add(channel, num_samples, moments);
+    return moments;
+}
 
-    for (auto adc_word : channel_charge_words) {
-        if (adc_word > threshold) charge_hits_[channel]++;
-    }
+template <typename Math>
+void ChargeAlgs::HitsAboveThreshold(SampleSpan channel_charge_words, uint16_t channel,
+                                    const kernels::SumSquares &baseline, ChargeSummary &summary) {
+    const SampleSpan baseline_words = channel_charge_words.subspan(0, BASELINE_SAMPLES);
+    if (baseline_words.empty()) return;
+
+    // Use baseline shifted threshold instead of baseline subtraction to avoid pesky 16b int overflows.
+    // The threshold only depends on this event so events can be summarized in any order.
+    // The samples are integers so the threshold is too, floor(baseline + 5 * RMS + 1).
+    const uint16_t threshold = Math::HitThreshold(baseline.sum, baseline.sum_sq, baseline_words.size(), HIT_THRESHOLD_RMS);
+    summary.charge_hits[channel] += kernels::CountAbove(channel_charge_words, threshold);
 }
 
+template <typename Math>
 void ChargeAlgs::UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) {
+    UpdateMinimalMetrics<Math>(summary_, lbw_metrics, metrics);
+}
+
+template <typename Math>
+void ChargeAlgs::UpdateMinimalMetrics(const ChargeSummary &summary, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) {
 
-    if (num_events_ < 1) { num_events_ = 1; } // Avoid divide by 0
+    uint64_t num_events = summary.num_events < 1 ? 1 : summary.num_events; // Avoid divide by 0
     /*
      * Finish the aggregated Baseline & RMS calculation and update the metrics
      * Average hits per event and the charge hits to the metrics
      */
-    std::cout << "num_events_ = " << num_events_ << std::endl;
+    LOG_DEBUG("num_events_ = {}", summary.num_events);
     std::array<uint32_t, NUM_CHARGE_CHANNELS> baseline_int{};
     std::array<uint32_t, NUM_CHARGE_CHANNELS> rms_int{};
     std::array<uint32_t, NUM_CHARGE_CHANNELS> avg_hits_int{};
     for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
-        // if (i < 10) std::cout << i << ":" << baseline_[i] / num_events_ << "|" << rms_[i] / num_events_ << "|" << charge_hits_[i] << std::endl;
-        baseline_int[i] = static_cast<uint32_t>(baseline_[i] / num_events_);
+        // Averaged over every event, as the metrics always have been
+        baseline_int[i] = Math::Mean(summary.baseline[i], num_events * ChargeSummary::MEAN_SCALE);
         // TODO could perform the sqrt on ground for safety and efficiency
-        // check to make sure rms is non-negative, should never be but better to avoid NaN
-        rms_int[i] = static_cast<uint32_t>((variance_[i] < 0) ? INT16_MAX : 15 * (std::sqrt(variance_[i] / num_events_)));
-        avg_hits_int[i] = static_cast<uint32_t>(15 * (charge_hits_[i] / num_events_));
-        // if (i < 10) std::cout << "  ->" << baseline_int[i] << "|" << rms_int[i] << "|" << avg_hits_int[i] << std::endl;
+        // the variance numerators are sums of squares so it can't go negative
+        rms_int[i] = Math::ScaledRms(summary.variance[i], num_events * ChargeSummary::VARIANCE_SCALE, METRIC_SCALE);
+        avg_hits_int[i] = static_cast<uint32_t>(METRIC_SCALE * (summary.charge_hits[i] / num_events));
     }
 
     // Update the metrics
@@ -79,8 +122,8 @@ void ChargeAlgs::UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &
 
 }
 
-void ChargeAlgs::GetChargeEvent(EventStruct &event) {
-    std::cout << event.charge_adc.size() << "/" << charge_oneframe_samples_.size() << std::endl;
+void ChargeAlgs::GetChargeEvent(const EventStruct &event) {
+    LOG_DEBUG("{}/{}", event.charge_adc.size(), charge_oneframe_samples_.size());
     for (size_t j = 0; j < event.charge_adc.size(); j++) {
         auto charge_one_frame_size = static_cast<size_t>(event.charge_adc[j].size() / 3);
         charge_oneframe_samples_[event.charge_channel[j]].resize(charge_one_frame_size);
@@ -90,6 +133,17 @@ void ChargeAlgs::GetChargeEvent(EventStruct &event) {
     }
 }
 
+void ChargeAlgs::GetChargeEvent(const FlatEvent &event) {
+    for (size_t j = 0; j < event.NumChargeChannels(); j++) {
+        SampleSpan samples = event.ChargeSamples(j);
+        auto charge_one_frame_size = static_cast<size_t>(samples.size() / 3);
+        charge_oneframe_samples_[event.ChargeChannel(j)].resize(charge_one_frame_size);
+        std::copy(samples.begin() + charge_one_frame_size,
+                  samples.begin() + 2 * charge_one_frame_size,
+                  charge_oneframe_samples_[event.ChargeChannel(j)].data());
+    }
+}
+
 std::vector<uint32_t> ChargeAlgs::UpdateChargeEvent(TpcMonitorChargeEvent &tpc_charge_metric, size_t channel) {
     tpc_charge_metric.setChannelNumber(channel);
     tpc_charge_metric.setChargeSamples(charge_oneframe_samples_[channel]);
@@ -97,18 +151,35 @@ std::vector<uint32_t> ChargeAlgs::UpdateChargeEvent(TpcMonitorChargeEvent &tpc_c
     return tpc_charge_metric.serialize();
 }
 
+void ChargeAlgs::EncodeChargeEvent(size_t channel, std::vector<uint32_t> &out) const {
+    const ConstSpan<uint32_t> samples(charge_oneframe_samples_.at(channel));
+    // Baseline from the leading samples so a quiet channel's deltas start near 0
+    size_t num_samples = std::min(BASELINE_SAMPLES, samples.size());
+    uint64_t baseline_sum = 0;
+    for (size_t i = 0; i < num_samples; i++) baseline_sum += samples[i];
+    auto baseline = static_cast<uint16_t>(num_samples > 0 ? baseline_sum / num_samples : 0);
+    waveform_codec::Encode(samples, baseline, out);
+}
+
 
 void ChargeAlgs::Clear() {
     // Clear the metrics between queries
+    summary_.Clear();
     for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
-        baseline_[i] = 0;
-        variance_[i] = 0;
-        charge_hits_[i] = 0;
         std::fill(charge_oneframe_samples_[i].begin(), charge_oneframe_samples_[i].end(), 0);
     }
-    num_events_ = 0;
 }
 
 //bool ChargeAlgs::UpdateMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) {
 //    return true;
 //}
+
+// Both arithmetic policies are built so they can be compared side by side, see benchmarks/math_bench.cpp
+template void ChargeAlgs::MinimalSummary<metric_math::DoubleMath>(const FlatEvent&, ChargeSummary&, ChargeStats*);
+template void ChargeAlgs::MinimalSummary<metric_math::IntegerMath>(const FlatEvent&, ChargeSummary&, ChargeStats*);
+template void ChargeAlgs::HitsAboveThreshold<metric_math::DoubleMath>(SampleSpan, uint16_t, const kernels::SumSquares&, ChargeSummary&);
+template void ChargeAlgs::HitsAboveThreshold<metric_math::IntegerMath>(SampleSpan, uint16_t, const kernels::SumSquares&, ChargeSummary&);
+template void ChargeAlgs::UpdateMinimalMetrics<metric_math::DoubleMath>(LowBwTpcMonitor&, TpcMonitor&);
+template void ChargeAlgs::UpdateMinimalMetrics<metric_math::IntegerMath>(LowBwTpcMonitor&, TpcMonitor&);
+template void ChargeAlgs::UpdateMinimalMetrics<metric_math::DoubleMath>(const ChargeSummary&, LowBwTpcMonitor&, TpcMonitor&);
+template void ChargeAlgs::UpdateMinimalMetrics<metric_math::IntegerMath>(const ChargeSummary&, LowBwTpcMonitor&, TpcMonitor&);
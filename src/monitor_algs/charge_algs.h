@@ -5,11 +5,40 @@
 #ifndef CHARGE_ALGS_H
 #define CHARGE_ALGS_H
 
-//#include "monitor_algs_base.hpp"
+#include "monitor_algs_base.hpp"
 #include "tpc_monitor.h"
 #include "process_events.h"
 #include "tpc_monitor_lbw.h"
 #include "tpc_monitor_charge_event.h"
+#include "sample_span.h"
+#include "flat_event.h"
+#include "simd_kernels.h"
+#include "running_stats.h"
+#include "metric_math.h"
+
+/*
+ * Per-channel minimal summary accumulators. Everything is kept as exact integer sums so partial
+ * summaries from different threads or event slices merge to a bit-identical result in any order.
+ * The metrics average the per-event baseline and variance over the events, each event's mean
+ * and variance are kept exact by scaling them with a multiple of every possible sample count.
+ */
+struct ChargeSummary {
+    // lcm(1..10), divisible by any number of baseline samples an event can have
+    constexpr static uint64_t MEAN_SCALE = 2520;
+    constexpr static uint64_t VARIANCE_SCALE = MEAN_SCALE * MEAN_SCALE;
+
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> baseline{0};  // sum of the event baselines x MEAN_SCALE
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> variance{0};  // sum of the event variances x VARIANCE_SCALE
+    std::array<size_t, NUM_CHARGE_CHANNELS> charge_hits{0};
+    size_t num_events = 0;
+
+    void Merge(const ChargeSummary &other);
+    // Undo a Merge, e.g. an event leaving a rolling window
+    void Subtract(const ChargeSummary &other);
+    void Clear() { *this = ChargeSummary(); }
+};
+
+using ChargeStats = RunningStats<NUM_CHARGE_CHANNELS>;
 
 class ChargeAlgs {
 public:
@@ -20,13 +49,38 @@ public:
 //    bool UpdateMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) override;
     void Clear();
     // Minimal or low-bandwidth
-    void MinimalSummary(EventStruct &event);
+    void MinimalSummary(const EventStruct &event);
+    void MinimalSummary(const FlatEvent &event) { MinimalSummary(event, summary_, &running_stats_); }
+    // Accumulate into a caller owned partial, e.g. one per worker thread. The running stats
+    // depend on event order so they are only updated when given. Math picks double or
+    // integer-only arithmetic, see metric_math.h, both give identical summaries.
+    template <typename Math = metric_math::Default>
+    static void MinimalSummary(const FlatEvent &event, ChargeSummary &summary, ChargeStats *stats = nullptr);
+    void Merge(const ChargeSummary &partial) { summary_.Merge(partial); }
+    const ChargeSummary& Summary() const { return summary_; }
+    template <typename Math = metric_math::Default>
     void UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics);
-    void BaselineRms(const std::vector<uint16_t> &channel_charge_words, uint16_t channel);
-    void HitsAboveThreshold(const std::vector<uint16_t> &channel_charge_words, uint16_t channel);
+    template <typename Math = metric_math::Default>
+    static void UpdateMinimalMetrics(const ChargeSummary &summary, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics);
+    // Views are spans over the decoded event's or the flat event's sample buffers, no copies either way.
+    // The baseline moments are returned so the hit threshold uses this event's baseline & RMS.
+    // Note these changed the downlinked RMS and hit counts: the variance used to be taken about the
+    // running baseline of the events so far and the threshold was the accumulated baseline_ +
+    // 5 * variance_ + 1 sums, both depended on event order and the threshold grew with every event.
+    static kernels::SumSquares BaselineRms(SampleSpan channel_charge_words, uint16_t channel, ChargeSummary &summary,
+                                           ChargeStats *stats = nullptr);
+    template <typename Math = metric_math::Default>
+    static void HitsAboveThreshold(SampleSpan channel_charge_words, uint16_t channel,
+                                   const kernels::SumSquares &baseline, ChargeSummary &summary);
+    // Windowed & EWMA baseline/RMS, kept across Clear() so they can be read at any time
+    const ChargeStats& RunningBaseline() const { return running_stats_; }
+    void ResetRunningBaseline(size_t window_events, uint8_t ewma_shift) { running_stats_ = ChargeStats(window_events, ewma_shift); }
     // Return an event
-    void GetChargeEvent(EventStruct &event);
+    void GetChargeEvent(const EventStruct &event);
+    void GetChargeEvent(const FlatEvent &event);
     std::vector<uint32_t> UpdateChargeEvent(TpcMonitorChargeEvent &tpc_charge_metric, size_t channel);
+    // Append the channel's waveform in the compressed payload format
+    void EncodeChargeEvent(size_t channel, std::vector<uint32_t> &out) const;
 
 private:
 
@@ -38,15 +92,39 @@ private:
     // constexpr static size_t NUM_CHANNELS = 192;
     // constexpr static size_t NUM_SAMPLES = 763;
 
-    Histogram charge_histogram_{1024, 4096, 16};
+    // Number of leading samples used for the baseline & RMS
+    constexpr static size_t BASELINE_SAMPLES = 10;
+    static_assert(BASELINE_SAMPLES <= 10, "Every baseline sample count has to divide ChargeSummary::MEAN_SCALE");
+    // Hit threshold is this many RMS above the event baseline
+    constexpr static uint32_t HIT_THRESHOLD_RMS = 5;
+    // The metrics carry the RMS and average hits scaled by this
+    constexpr static uint32_t METRIC_SCALE = 15;
 
-    std::array<double, NUM_CHARGE_CHANNELS> variance_{0};
-    std::array<double, NUM_CHARGE_CHANNELS> baseline_{0};
-    std::array<size_t, NUM_CHARGE_CHANNELS> charge_hits_{0};
+    ChargeSummary summary_;
+    ChargeStats running_stats_;
     // std::array<std::array<uint32_t, CHARGE_ONE_FRAME>, NUM_CHARGE_CHANNELS> charge_oneframe_samples_{0};
     std::array<std::vector<uint32_t>, NUM_CHARGE_CHANNELS> charge_oneframe_samples_;
-    size_t num_events_ = 0;
 
 };
 
+/*
+ * The charge minimal summary as a pipeline algorithm, see alg_pipeline.h
+ */
+class ChargeSummaryAlg : public MonitorAlgBase<ChargeSummaryAlg, ChargeSummary> {
+public:
+    constexpr static uint32_t ALG_ID = 0x1;
+
+    void ProcessEvent(const FlatEvent &event, Partial &partial) const {
+        ChargeAlgs::MinimalSummary(event, partial, stats_);
+    }
+    void UpdateMetrics(const Partial &partial, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) const {
+        ChargeAlgs::UpdateMinimalMetrics(partial, lbw_metrics, metrics);
+    }
+    // Only for pipelines that see the events in order, e.g. the live window
+    void SetRunningStats(ChargeStats *stats) { stats_ = stats; }
+
+private:
+    ChargeStats *stats_ = nullptr;
+};
+
 #endif //CHARGE_ALGS_H
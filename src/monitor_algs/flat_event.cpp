@@ -0,0 +1,50 @@
+//
+// Structure-of-arrays event layout, all samples of a kind in one contiguous buffer.
+//
+
+#include "flat_event.h"
+
+void FlatEvent::Fill(const EventStruct &event, const ChannelSelection &selection) {
+    Clear();
+
+    // Size the sample buffers once so the appends below never reallocate mid-event
+    size_t num_charge_samples = 0;
+    for (size_t i = 0; i < event.charge_adc.size(); i++) {
+        if (selection.Charge(event.charge_channel[i])) num_charge_samples += event.charge_adc[i].size();
+    }
+    charge_samples_.reserve(num_charge_samples);
+    for (size_t i = 0; i < event.charge_adc.size(); i++) {
+        if (!selection.Charge(event.charge_channel[i])) continue;
+        charge_channel_.push_back(event.charge_channel[i]);
+        charge_offset_.push_back(static_cast<uint32_t>(charge_samples_.size()));
+        charge_length_.push_back(static_cast<uint32_t>(event.charge_adc[i].size()));
+        charge_samples_.insert(charge_samples_.end(), event.charge_adc[i].begin(), event.charge_adc[i].end());
+    }
+
+    size_t num_light_samples = 0;
+    for (size_t i = 0; i < event.light_adc.size(); i++) {
+        if (selection.Light(event.light_channel[i])) num_light_samples += event.light_adc[i].size();
+    }
+    light_samples_.reserve(num_light_samples);
+    for (size_t i = 0; i < event.light_adc.size(); i++) {
+        if (!selection.Light(event.light_channel[i])) continue;
+        light_channel_.push_back(event.light_channel[i]);
+        light_trigger_id_.push_back(event.light_trigger_id[i]);
+        light_offset_.push_back(static_cast<uint32_t>(light_samples_.size()));
+        light_length_.push_back(static_cast<uint32_t>(event.light_adc[i].size()));
+        light_samples_.insert(light_samples_.end(), event.light_adc[i].begin(), event.light_adc[i].end());
+    }
+}
+
+void FlatEvent::Clear() {
+    // clear() keeps the capacity, which is the point of reusing the event
+    charge_samples_.clear();
+    charge_channel_.clear();
+    charge_offset_.clear();
+    charge_length_.clear();
+    light_samples_.clear();
+    light_channel_.clear();
+    light_trigger_id_.clear();
+    light_offset_.clear();
+    light_length_.clear();
+}
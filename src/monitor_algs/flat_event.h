@@ -0,0 +1,63 @@
+//
+// Structure-of-arrays event layout, all samples of a kind in one contiguous buffer.
+//
+
+#ifndef FLAT_EVENT_H
+#define FLAT_EVENT_H
+
+#include "process_events.h"
+#include "sample_span.h"
+#include "channel_selection.h"
+#include <cstdint>
+#include <vector>
+
+class FlatEvent {
+public:
+    FlatEvent() = default;
+    ~FlatEvent() = default;
+
+    /**
+    *  Pack a decoded event into the flat layout. The buffers keep their capacity between
+    *  events so after the first few events this does not allocate.
+    *
+    *   @param [in] event:  The EvenStruct holding the decoded event data
+    *   @param [in] selection:  Channels to keep, the others are left out as if they were not read out
+    */
+    void Fill(const EventStruct &event, const ChannelSelection &selection = ChannelSelection::All());
+    void Clear();
+
+    // Charge, one entry per channel in readout order
+    size_t NumChargeChannels() const { return charge_channel_.size(); }
+    uint16_t ChargeChannel(size_t i) const { return charge_channel_[i]; }
+    SampleSpan ChargeSamples(size_t i) const {
+        return {charge_samples_.data() + charge_offset_[i], charge_length_[i]};
+    }
+
+    // Light, one entry per ROI in readout order
+    size_t NumLightRois() const { return light_channel_.size(); }
+    uint16_t LightChannel(size_t i) const { return light_channel_[i]; }
+    uint16_t LightTriggerId(size_t i) const { return light_trigger_id_[i]; }
+    SampleSpan LightSamples(size_t i) const {
+        return {light_samples_.data() + light_offset_[i], light_length_[i]};
+    }
+
+    // The whole sample buffers, for kernels that stream over every sample
+    SampleSpan ChargeBuffer() const { return charge_samples_; }
+    SampleSpan LightBuffer() const { return light_samples_; }
+
+private:
+
+    std::vector<uint16_t> charge_samples_;
+    std::vector<uint16_t> charge_channel_;
+    std::vector<uint32_t> charge_offset_;
+    std::vector<uint32_t> charge_length_;
+
+    std::vector<uint16_t> light_samples_;
+    std::vector<uint16_t> light_channel_;
+    std::vector<uint16_t> light_trigger_id_;
+    std::vector<uint32_t> light_offset_;
+    std::vector<uint32_t> light_length_;
+
+};
+
+#endif //FLAT_EVENT_H
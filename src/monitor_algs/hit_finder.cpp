@@ -0,0 +1,148 @@
+//
+// Charge hit finding, contiguous regions above threshold with their peak, time, integral and width.
+//
+
+#include "hit_finder.h"
+#include "simd_kernels.h"
+#include <algorithm>
+
+size_t HitList::Size() const {
+    size_t size = 0;
+    for (auto n : num_hits) size += n;
+    return size;
+}
+
+void HitSummary::Merge(const HitSummary &other) {
+    for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
+        num_hits[i] += other.num_hits[i];
+        num_measured[i] += other.num_measured[i];
+        amplitude_sum[i] += other.amplitude_sum[i];
+        integral_sum[i] += other.integral_sum[i];
+        width_sum[i] += other.width_sum[i];
+    }
+    num_events += other.num_events;
+}
+
+void HitSummary::Subtract(const HitSummary &other) {
+    for (size_t i = 0; i < NUM_CHARGE_CHANNELS; i++) {
+        num_hits[i] -= other.num_hits[i];
+        num_measured[i] -= other.num_measured[i];
+        amplitude_sum[i] -= other.amplitude_sum[i];
+        integral_sum[i] -= other.integral_sum[i];
+        width_sum[i] -= other.width_sum[i];
+    }
+    num_events -= other.num_events;
+}
+
+template <typename Math>
+size_t HitFinder::FindHits(SampleSpan samples, uint16_t channel, Hit *hits, size_t max_hits) {
+    const SampleSpan baseline_words = samples.subspan(0, BASELINE_SAMPLES);
+    if (baseline_words.empty()) return 0;
+    const kernels::SumSquares moments = kernels::SumAndSumSquares(baseline_words);
+    const uint16_t threshold = Math::HitThreshold(moments.sum, moments.sum_sq, baseline_words.size(), HIT_THRESHOLD_RMS);
+    const auto baseline = static_cast<uint16_t>(Math::Mean(moments.sum, baseline_words.size()));
+
+    // The vectorized scan finds the regions, only the few samples inside them are visited again
+    std::array<kernels::Region, HitList::MAX_HITS_PER_CHANNEL> regions{};
+    const size_t num_regions = kernels::FindRegions(samples, threshold, regions.data(), std::min(max_hits, regions.size()));
+    const size_t num_kept = std::min({num_regions, max_hits, regions.size()});
+    for (size_t r = 0; r < num_kept; r++) {
+        Hit &hit = hits[r];
+        hit.channel = channel;
+        hit.start = static_cast<uint16_t>(regions[r].begin);
+        hit.width = static_cast<uint16_t>(regions[r].end - regions[r].begin);
+        uint16_t peak = 0;
+        uint32_t integral = 0;
+        for (uint32_t s = regions[r].begin; s < regions[r].end; s++) {
+            // Above the threshold so above the baseline too
+            integral += samples[s] - baseline;
+            if (samples[s] > peak) {
+                peak = samples[s];
+                hit.peak_time = static_cast<uint16_t>(s);
+            }
+        }
+        hit.peak_amplitude = static_cast<uint16_t>(peak - baseline);
+        hit.integral = integral;
+    }
+    return num_regions;
+}
+
+void HitFinder::FindHits(const FlatEvent &event, HitList &hit_list) {
+    hit_list.Clear();
+    for (size_t i = 0; i < event.NumChargeChannels(); i++) {
+        uint16_t channel = event.ChargeChannel(i);
+        if (channel > NUM_CHARGE_CHANNELS-1) continue;
+        // A channel only appears once per event, append in case it doesn't
+        const size_t used = hit_list.num_hits[channel];
+        const size_t found = FindHits(event.ChargeSamples(i), channel, hit_list.hits[channel].data() + used,
+                                      HitList::MAX_HITS_PER_CHANNEL - used);
+        const size_t kept = std::min(found, HitList::MAX_HITS_PER_CHANNEL - used);
+        hit_list.num_hits[channel] = static_cast<uint16_t>(used + kept);
+        hit_list.num_dropped += found - kept;
+    }
+}
+
+void HitFinder::SerializeHits(const HitList &hit_list, const MetricHeader &header, std::vector<uint32_t> &out) {
+    out.clear();
+    out.reserve(5 + 2 * hit_list.Size());
+    out.push_back(header.run_number);
+    out.push_back(header.file_number);
+    out.push_back(header.evt_number);
+    out.push_back(static_cast<uint32_t>(hit_list.Size()));
+    out.push_back(static_cast<uint32_t>(hit_list.num_dropped));
+    for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) {
+        for (size_t h = 0; h < hit_list.num_hits[ch]; h++) {
+            const Hit &hit = hit_list.hits[ch][h];
+            out.push_back(uint32_t{hit.channel} << 24 | std::min<uint32_t>(hit.peak_time, 0xFFF) << 12 |
+                          std::min<uint32_t>(hit.width, 0xFFF));
+            out.push_back(std::min<uint32_t>(hit.peak_amplitude, 0xFFF) << 20 | std::min<uint32_t>(hit.integral, 0xFFFFF));
+        }
+    }
+}
+
+void HitFinderAlg::ProcessEvent(const FlatEvent &event, Partial &partial) const {
+    // Only the per-channel sums are kept here so the hits live on the stack for one channel
+    std::array<Hit, HitList::MAX_HITS_PER_CHANNEL> hits{};
+    for (size_t i = 0; i < event.NumChargeChannels(); i++) {
+        uint16_t channel = event.ChargeChannel(i);
+        if (channel > NUM_CHARGE_CHANNELS-1) continue;
+        const size_t found = HitFinder::FindHits(event.ChargeSamples(i), channel, hits.data(), hits.size());
+        // Rates count every hit, the amplitudes are of the ones measured
+        const size_t measured = std::min(found, hits.size());
+        partial.num_hits[channel] += found;
+        partial.num_measured[channel] += measured;
+        for (size_t h = 0; h < measured; h++) {
+            partial.amplitude_sum[channel] += hits[h].peak_amplitude;
+            partial.integral_sum[channel] += hits[h].integral;
+            partial.width_sum[channel] += hits[h].width;
+        }
+    }
+    partial.num_events++;
+}
+
+void HitFinderAlg::SerializeMetrics(const Partial &partial, const MetricHeader &header, std::vector<AlgMetric> &out) const {
+    using Math = metric_math::Default;
+    out.push_back({HIT_SUMMARY_METRIC, {}});
+    std::vector<uint32_t> &payload = out.back().payload;
+    payload.reserve(4 + 4 * NUM_CHARGE_CHANNELS);
+    payload.push_back(header.run_number);
+    payload.push_back(header.file_number);
+    payload.push_back(header.evt_number);
+    payload.push_back(static_cast<uint32_t>(partial.num_events));
+    const uint64_t num_events = partial.num_events < 1 ? 1 : partial.num_events; // Avoid divide by 0
+    for (size_t ch = 0; ch < NUM_CHARGE_CHANNELS; ch++) {
+        payload.push_back(Math::Mean(METRIC_SCALE * partial.num_hits[ch], num_events));
+        // Means of the measured hits, at most MAX_HITS_PER_CHANNEL per event
+        const uint64_t measured = partial.num_measured[ch];
+        if (measured == 0) {
+            payload.insert(payload.end(), 3, 0);
+            continue;
+        }
+        payload.push_back(Math::Mean(partial.amplitude_sum[ch], measured));
+        payload.push_back(Math::Mean(partial.integral_sum[ch], measured));
+        payload.push_back(Math::Mean(partial.width_sum[ch], measured));
+    }
+}
+
+template size_t HitFinder::FindHits<metric_math::DoubleMath>(SampleSpan, uint16_t, Hit*, size_t);
+template size_t HitFinder::FindHits<metric_math::IntegerMath>(SampleSpan, uint16_t, Hit*, size_t);
@@ -0,0 +1,115 @@
+//
+// Charge hit finding, contiguous regions above threshold with their peak, time, integral and width.
+//
+
+#ifndef HIT_FINDER_H
+#define HIT_FINDER_H
+
+#include "monitor_algs_base.hpp"
+#include "process_events.h"
+#include "flat_event.h"
+#include "sample_span.h"
+#include "metric_math.h"
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// One pulse on a channel, amplitudes and integral are above the event baseline
+struct Hit {
+    uint16_t channel;
+    uint16_t start;          // first sample above threshold
+    uint16_t width;          // samples above threshold
+    uint16_t peak_time;      // sample of the peak
+    uint16_t peak_amplitude;
+    uint32_t integral;
+};
+
+/*
+ * The hits of one event in fixed per-channel arrays, sized once and reused for every event.
+ * A channel with more hits than fit keeps the first MAX_HITS_PER_CHANNEL and counts the rest.
+ */
+struct HitList {
+    constexpr static size_t MAX_HITS_PER_CHANNEL = 32;
+
+    std::array<std::array<Hit, MAX_HITS_PER_CHANNEL>, NUM_CHARGE_CHANNELS> hits;
+    std::array<uint16_t, NUM_CHARGE_CHANNELS> num_hits{0};
+    size_t num_dropped = 0;
+
+    void Clear() { num_hits.fill(0); num_dropped = 0; }
+    size_t Size() const;
+};
+
+/*
+ * Per-channel hit rate & amplitude accumulators, exact integer sums so they merge like the
+ * other summaries.
+ */
+struct HitSummary {
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> num_hits{0};
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> num_measured{0};  // hits the sums below are over
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> amplitude_sum{0};
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> integral_sum{0};
+    std::array<uint64_t, NUM_CHARGE_CHANNELS> width_sum{0};
+    size_t num_events = 0;
+
+    void Merge(const HitSummary &other);
+    void Subtract(const HitSummary &other);
+    void Clear() { *this = HitSummary(); }
+};
+
+class HitFinder {
+public:
+
+    /**
+    *  Find the hits on one channel, the threshold is HIT_THRESHOLD_RMS above this waveform's
+    *  own baseline like the minimal summary hit count.
+    *
+    *   @param [out] hits:  The first max_hits hits
+    *
+    * @return  Number of hits found, may be more than max_hits
+    */
+    template <typename Math = metric_math::Default>
+    static size_t FindHits(SampleSpan samples, uint16_t channel, Hit *hits, size_t max_hits);
+
+    // Every charge channel of the event into the list, which is cleared first
+    static void FindHits(const FlatEvent &event, HitList &hit_list);
+
+    /**
+    *  Compact hit list metric, all 32b words:
+    *   [0-2]  run, file, event
+    *   [3]    number of hits sent
+    *   [4]    number of hits dropped
+    *   then 2 words per hit:
+    *     channel << 24 | peak_time << 12 | width, times and width saturate at 0xFFF
+    *     peak_amplitude << 20 | integral, amplitude saturates at 0xFFF, integral at 0xFFFFF
+    */
+    static void SerializeHits(const HitList &hit_list, const MetricHeader &header, std::vector<uint32_t> &out);
+
+    // Number of leading samples used for the baseline & RMS
+    constexpr static size_t BASELINE_SAMPLES = 10;
+    constexpr static uint32_t HIT_THRESHOLD_RMS = 5;
+};
+
+class HitFinderAlg : public MonitorAlgBase<HitFinderAlg, HitSummary> {
+public:
+    constexpr static uint32_t ALG_ID = 0x8;
+    constexpr static uint32_t HIT_SUMMARY_METRIC = 0x400B;
+
+    void ProcessEvent(const FlatEvent &event, Partial &partial) const;
+
+    /**
+    *  Payload, all 32b words:
+    *   [0-2]  run, file, event
+    *   [3]    number of events summed
+    *   then per channel: 15 x hits per event, mean peak amplitude, mean integral, mean width
+    */
+    void SerializeMetrics(const Partial &partial, const MetricHeader &header, std::vector<AlgMetric> &out) const;
+
+    // Same scaling as the LBW average hits
+    constexpr static uint32_t METRIC_SCALE = 15;
+};
+
+// Hit list of a single event, sent with the event query waveforms
+constexpr static uint32_t HIT_LIST_METRIC = 0x400C;
+
+#endif //HIT_FINDER_H
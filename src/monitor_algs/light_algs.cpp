@@ -3,7 +3,11 @@
 //
 
 #include "light_algs.h"
+#include "simd_kernels.h"
+#include "waveform_codec.h"
+#include "logger.h"
 #include <cmath>
+#include <algorithm>
 
 
 //bool LightAlgs::ProcessEvent(EventStruct &event) {
@@ -13,48 +17,85 @@
 //    return true;
 //}
 
-void LightAlgs::MinimalSummary(EventStruct &event) {
+void LightSummary::Merge(const LightSummary &other) {
+    for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
+        baseline[i] += other.baseline[i];
+        variance[i] += other.variance[i];
+        light_rois[i] += other.light_rois[i];
+        light_baseline_rms_norm[i] += other.light_baseline_rms_norm[i];
+    }
+    num_events += other.num_events;
+}
+
+void LightSummary::Subtract(const LightSummary &other) {
+    for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
+        baseline[i] -= other.baseline[i];
+        variance[i] -= other.variance[i];
+        light_rois[i] -= other.light_rois[i];
+        light_baseline_rms_norm[i] -= other.light_baseline_rms_norm[i];
+    }
+    num_events -= other.num_events;
+}
+
+void LightAlgs::MinimalSummary(const EventStruct &event) {
     // The unbiased light readout corresponds to ID 0x4. We want to use this to get an unbiased snapshot
     // of channel baseline & RMS loosely correlated with the trigger since it initiates the unbiased readout
 
-    std::cout << "Size ID/Ch/ROI: " << event.light_trigger_id.size() << "/"
-            << event.light_channel.size() << "/" << event.light_adc.size() << std::endl;
+    LOG_DEBUG("Size ID/Ch/ROI: {}/{}/{}", event.light_trigger_id.size(), event.light_channel.size(), event.light_adc.size());
 
     for (size_t i = 0; i < event.light_channel.size(); i++) { // loop over each RI in the event
         if (event.light_channel[i] > NUM_LIGHT_CHANNELS-1) continue;
         if (event.light_trigger_id.at(i) != BEAM_GATE_DISC_ID) { // should be a Cosmic ie Disc 1 ROI
-            light_rois_[event.light_channel.at(i)]++;
+            summary_.light_rois[event.light_channel.at(i)]++;
             continue; // skip non-beam gate readout ROIs
         }
-        light_baseline_rms_norm_[event.light_channel.at(i)]++;
-        BaselineRms(event.light_adc.at(i), event.light_channel.at(i));
+        summary_.light_baseline_rms_norm[event.light_channel.at(i)]++;
+        BaselineRms(event.light_adc.at(i), event.light_channel.at(i), summary_, &running_stats_);
     }
-    num_events_++;
+    running_stats_.EndEvent();
+    summary_.num_events++;
 }
 
-void LightAlgs::BaselineRms(const std::vector<uint16_t> &light_roi_words, uint16_t channel) {
+void LightAlgs::MinimalSummary(const FlatEvent &event, LightSummary &summary, LightStats *stats) {
+    // Same as above but reading the channel and trigger ID columns of the flat layout
+    for (size_t i = 0; i < event.NumLightRois(); i++) {
+        uint16_t channel = event.LightChannel(i);
+        if (channel > NUM_LIGHT_CHANNELS-1) continue;
+        if (event.LightTriggerId(i) != BEAM_GATE_DISC_ID) {
+            summary.light_rois[channel]++;
+            continue;
+        }
+        summary.light_baseline_rms_norm[channel]++;
+        BaselineRms(event.LightSamples(i), channel, summary, stats);
+    }
+    if (stats != nullptr) stats->EndEvent();
+    summary.num_events++;
+}
+
+void LightAlgs::BaselineRms(SampleSpan light_roi_words, uint16_t channel, LightSummary &summary, LightStats *stats) {
     // Assuming we are receiving the unbiased light readout ROI
     // Calculate the baseline and RMS for the channel, only use the first 8 samples unless
     // there are <8 but shouldn't happen
-    size_t num_samples = light_roi_words.size() > 7 ? 8 : light_roi_words.size();
+    size_t num_samples = std::min(BASELINE_SAMPLES, light_roi_words.size());
     if (num_samples < 1) return;
 
-    double baseline_sum = 0;
-    for (size_t i = 0; i < num_samples; i++) { baseline_sum += light_roi_words[i]; }
-    baseline_sum /= num_samples;
-    baseline_[channel] += baseline_sum;
-
-    double variance_sum = 0;
-    for (size_t i = 0; i < num_samples; i++) {
-        variance_sum += (light_roi_words[i] - baseline_sum) * (light_roi_words[i] - baseline_sum);
-    }
-    variance_sum /= num_samples;
-    variance_[channel] += variance_sum;
+    // The ROI baseline is sum x / n and the variance about it (n sum x^2 - (sum x)^2) / n^2, scaled to exact integers
+    const kernels::SumSquares moments = kernels::SumAndSumSquares(light_roi_words.subspan(0, num_samples));
+    summary.baseline[channel] += moments.sum * (LightSummary::MEAN_SCALE / num_samples);
+    summary.variance[channel] += (num_samples * moments.sum_sq - moments.sum * moments.sum)
+                                 * (LightSummary::VARIANCE_SCALE / (num_samples * num_samples));
+    if (stats != nullptr) stats->Add(channel, num_samples, moments);
 }
 
 
+template <typename Math>
 void LightAlgs::UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) {
-    if (num_events_ < 1) { num_events_ = 1; } // Avoid divide by 0
+    UpdateMinimalMetrics<Math>(summary_, lbw_metrics, metrics);
+}
+
+template <typename Math>
+void LightAlgs::UpdateMinimalMetrics(const LightSummary &summary, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) {
+    size_t num_events = summary.num_events < 1 ? 1 : summary.num_events; // Avoid divide by 0
     /*
      * Finish the aggregated Baseline & RMS calculation and update the metrics
      * Average hits ROIs event and the charge hits to the metrics
@@ -64,11 +105,13 @@ void LightAlgs::UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &m
     std::array<uint32_t, NUM_LIGHT_CHANNELS> rms_int{};
     std::array<uint32_t, NUM_LIGHT_CHANNELS> avg_rois_int{};
     for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
-        baseline_int[i] = static_cast<int>(baseline_[i] / light_baseline_rms_norm_[i]);
+        avg_rois_int[i] = static_cast<uint32_t>(METRIC_SCALE * (summary.light_rois[i] / num_events));
+        const uint64_t num_rois = summary.light_baseline_rms_norm[i];
+        if (num_rois == 0) continue; // no beam gate ROIs on this channel
+        baseline_int[i] = Math::Mean(summary.baseline[i], num_rois * LightSummary::MEAN_SCALE);
         // TODO could perform the sqrt on ground for safety and efficiency
-        // check to make sure rms is non-negative, should never be but better to avoid NaN
-        rms_int[i] = static_cast<int>((variance_[i] < 0) ? INT16_MAX : 15 * (std::sqrt(variance_[i] / light_baseline_rms_norm_[i])));
-        avg_rois_int[i] = static_cast<uint32_t>(15 * (light_rois_[i] / num_events_));
+        // the variance numerators are sums of squares so it can't go negative
+        rms_int[i] = Math::ScaledRms(summary.variance[i], num_rois * LightSummary::VARIANCE_SCALE, METRIC_SCALE);
     }
 
     // update the metrics
@@ -77,16 +120,30 @@ void LightAlgs::UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &m
     lbw_metrics.setLightAvgNumRois(avg_rois_int);
 }
 
-size_t LightAlgs::GetLightEvent(EventStruct &event) {
+size_t LightAlgs::GetLightEvent(const EventStruct &event) {
+    // Only the cosmic ROIs are kept, packed so ROI i goes with light_roi_channels_[i]
+    light_roi_channels_.clear();
     light_cosmic_rois_.resize(event.light_adc.size());
     for (size_t i = 0; i < event.light_adc.size(); i++) {
         if (event.light_trigger_id[i] != COSMIC_DISC_ID) continue;
-        light_cosmic_rois_[i].resize(event.light_adc[i].size());
-        std::copy(event.light_adc[i].begin(),
-                  event.light_adc[i].end(),
-                  light_cosmic_rois_[i].begin());
+        auto &roi = light_cosmic_rois_[light_roi_channels_.size()];
+        roi.assign(event.light_adc[i].begin(), event.light_adc[i].end());
         light_roi_channels_.push_back(event.light_channel[i]);
     }
+    light_cosmic_rois_.resize(light_roi_channels_.size());
+    return light_roi_channels_.size();
+}
+
+size_t LightAlgs::GetLightEvent(const FlatEvent &event) {
+    light_roi_channels_.clear();
+    light_cosmic_rois_.resize(event.NumLightRois());
+    for (size_t i = 0; i < event.NumLightRois(); i++) {
+        if (event.LightTriggerId(i) != COSMIC_DISC_ID) continue;
+        SampleSpan samples = event.LightSamples(i);
+        light_cosmic_rois_[light_roi_channels_.size()].assign(samples.begin(), samples.end());
+        light_roi_channels_.push_back(event.LightChannel(i));
+    }
+    light_cosmic_rois_.resize(light_roi_channels_.size());
     return light_roi_channels_.size();
 }
 
@@ -98,17 +155,30 @@ std::vector<uint32_t> LightAlgs::UpdateLightEvent(TpcMonitorLightEvent &tpc_ligh
     return tpc_light_metric.serialize();
 }
 
+bool LightAlgs::EncodeLightEvent(size_t roi, std::vector<uint32_t> &out) const {
+    if (roi >= light_roi_channels_.size() || roi >= light_cosmic_rois_.size()) return false;
+    const ConstSpan<uint32_t> samples(light_cosmic_rois_[roi]);
+    size_t num_samples = std::min(BASELINE_SAMPLES, samples.size());
+    uint64_t baseline_sum = 0;
+    for (size_t i = 0; i < num_samples; i++) baseline_sum += samples[i];
+    auto baseline = static_cast<uint16_t>(num_samples > 0 ? baseline_sum / num_samples : 0);
+    out.push_back(light_roi_channels_[roi]);
+    waveform_codec::Encode(samples, baseline, out);
+    return true;
+}
+
 
 void LightAlgs::Clear() {
-    for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
-        variance_[i] = 0;
-        baseline_[i] = 0;
-        light_rois_[i] = 0;
-        light_baseline_rms_norm_[i] = 0;
-    }
+    summary_.Clear();
 
     for (auto & light_cosmic_roi : light_cosmic_rois_) {
         std::fill(light_cosmic_roi.begin(), light_cosmic_roi.end(), 0);
     }
     light_roi_channels_.clear();
 }
+
+// Both arithmetic policies are built so they can be compared side by side, see benchmarks/math_bench.cpp
+template void LightAlgs::UpdateMinimalMetrics<metric_math::DoubleMath>(LowBwTpcMonitor&, TpcMonitor&);
+template void LightAlgs::UpdateMinimalMetrics<metric_math::IntegerMath>(LowBwTpcMonitor&, TpcMonitor&);
+template void LightAlgs::UpdateMinimalMetrics<metric_math::DoubleMath>(const LightSummary&, LowBwTpcMonitor&, TpcMonitor&);
+template void LightAlgs::UpdateMinimalMetrics<metric_math::IntegerMath>(const LightSummary&, LowBwTpcMonitor&, TpcMonitor&);
@@ -5,11 +5,39 @@
 #ifndef LIGHT_ALGS_H
 #define LIGHT_ALGS_H
 
-//#include "monitor_algs_base.hpp"
+#include "monitor_algs_base.hpp"
 #include "tpc_monitor.h"
 #include "process_events.h"
 #include "tpc_monitor_lbw.h"
 #include "tpc_monitor_light_event.h"
+#include "sample_span.h"
+#include "flat_event.h"
+#include "running_stats.h"
+#include "metric_math.h"
+
+/*
+ * Per-channel minimal summary accumulators, exact integer sums so partial summaries
+ * from different threads or event slices merge to a bit-identical result. The metrics
+ * average the per-ROI baseline and variance over the beam gate ROIs, see ChargeSummary.
+ */
+struct LightSummary {
+    // lcm(1..8), divisible by any number of baseline samples a ROI can have
+    constexpr static uint64_t MEAN_SCALE = 840;
+    constexpr static uint64_t VARIANCE_SCALE = MEAN_SCALE * MEAN_SCALE;
+
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> baseline{0};  // sum of the ROI baselines x MEAN_SCALE
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> variance{0};  // sum of the ROI variances x VARIANCE_SCALE
+    std::array<size_t, NUM_LIGHT_CHANNELS> light_rois{0};
+    std::array<size_t, NUM_LIGHT_CHANNELS> light_baseline_rms_norm{0};
+    size_t num_events = 0;
+
+    void Merge(const LightSummary &other);
+    // Undo a Merge, e.g. an event leaving a rolling window
+    void Subtract(const LightSummary &other);
+    void Clear() { *this = LightSummary(); }
+};
+
+using LightStats = RunningStats<NUM_LIGHT_CHANNELS>;
 
 class LightAlgs {
 public:
@@ -20,25 +48,65 @@ public:
 //    bool UpdateMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) override;
     void Clear();
 
-    void MinimalSummary(EventStruct& event);
+    void MinimalSummary(const EventStruct& event);
+    void MinimalSummary(const FlatEvent& event) { MinimalSummary(event, summary_, &running_stats_); }
+    // Accumulate into a caller owned partial, e.g. one per worker thread. The running stats
+    // depend on event order so they are only updated when given.
+    static void MinimalSummary(const FlatEvent& event, LightSummary &summary, LightStats *stats = nullptr);
+    void Merge(const LightSummary &partial) { summary_.Merge(partial); }
+    const LightSummary& Summary() const { return summary_; }
+    // Math picks double or integer-only arithmetic, see metric_math.h
+    template <typename Math = metric_math::Default>
     void UpdateMinimalMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics);
+    template <typename Math = metric_math::Default>
+    static void UpdateMinimalMetrics(const LightSummary &summary, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics);
+    // Windowed & EWMA beam gate ROI baseline/RMS, kept across Clear()
+    const LightStats& RunningBaseline() const { return running_stats_; }
+    void ResetRunningBaseline(size_t window_events, uint8_t ewma_shift) { running_stats_ = LightStats(window_events, ewma_shift); }
     // Return an event
-    size_t GetLightEvent(EventStruct &event);
+    size_t GetLightEvent(const EventStruct &event);
+    size_t GetLightEvent(const FlatEvent &event);
     std::vector<uint32_t> UpdateLightEvent(TpcMonitorLightEvent &tpc_light_metric, size_t roi);
+    // Append the ROI's channel and waveform in the compressed payload format, false if there is no ROI
+    bool EncodeLightEvent(size_t roi, std::vector<uint32_t> &out) const;
     bool isLightRoi() { return !(light_roi_channels_.empty() || light_cosmic_rois_.empty()); }
 
     private:
 
-    void BaselineRms(const std::vector<uint16_t> &light_roi_words, uint16_t channel);
+    static void BaselineRms(SampleSpan light_roi_words, uint16_t channel, LightSummary &summary, LightStats *stats);
+
+    // Number of leading samples used for the baseline & RMS
+    constexpr static size_t BASELINE_SAMPLES = 8;
+    static_assert(BASELINE_SAMPLES <= 8, "Every baseline sample count has to divide LightSummary::MEAN_SCALE");
+    // The metrics carry the RMS and average ROIs scaled by this
+    constexpr static uint32_t METRIC_SCALE = 15;
+
+    LightSummary summary_;
+    LightStats running_stats_;
+    // The last event's cosmic ROIs and their channels, same order
+    std::vector<std::vector<uint32_t>> light_cosmic_rois_;
+    std::vector<uint16_t> light_roi_channels_;
+
+};
+
+/*
+ * The light minimal summary as a pipeline algorithm, see alg_pipeline.h
+ */
+class LightSummaryAlg : public MonitorAlgBase<LightSummaryAlg, LightSummary> {
+public:
+    constexpr static uint32_t ALG_ID = 0x2;
 
-    std::array<double, NUM_LIGHT_CHANNELS> variance_{0};
-    std::array<double, NUM_LIGHT_CHANNELS> baseline_{0};
-    std::array<size_t, NUM_LIGHT_CHANNELS> light_rois_{0};
-    std::array<size_t, NUM_LIGHT_CHANNELS> light_baseline_rms_norm_{0};
-    std::vector<std::vector<uint32_t>> light_cosmic_rois_{0};
-    std::vector<uint16_t> light_roi_channels_{0};
-    size_t num_events_ = 0;
+    void ProcessEvent(const FlatEvent &event, Partial &partial) const {
+        LightAlgs::MinimalSummary(event, partial, stats_);
+    }
+    void UpdateMetrics(const Partial &partial, LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) const {
+        LightAlgs::UpdateMinimalMetrics(partial, lbw_metrics, metrics);
+    }
+    // Only for pipelines that see the events in order, e.g. the live window
+    void SetRunningStats(LightStats *stats) { stats_ = stats; }
 
+private:
+    LightStats *stats_ = nullptr;
 };
 
 #endif //LIGHT_ALGS_H
@@ -0,0 +1,160 @@
+//
+// Light ROI pulse analysis, pulse height, integral and arrival time plus PMT channel coincidences.
+//
+
+#include "light_pulses.h"
+#include "simd_kernels.h"
+#include "metric_math.h"
+#include <algorithm>
+
+size_t ChannelMask::Count() const {
+    size_t count = 0;
+    for (auto word : words) count += static_cast<size_t>(__builtin_popcountll(word));
+    return count;
+}
+
+void LightPulseSummary::Merge(const LightPulseSummary &other) {
+    for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
+        num_rois[i] += other.num_rois[i];
+        num_pulses[i] += other.num_pulses[i];
+        height_sum[i] += other.height_sum[i];
+        integral_sum[i] += other.integral_sum[i];
+        arrival_sum[i] += other.arrival_sum[i];
+    }
+    for (size_t i = 0; i < multiplicity.size(); i++) multiplicity[i] += other.multiplicity[i];
+    for (size_t i = 0; i < coincidences.size(); i++) coincidences[i] += other.coincidences[i];
+    num_events += other.num_events;
+}
+
+void LightPulseSummary::Subtract(const LightPulseSummary &other) {
+    for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
+        num_rois[i] -= other.num_rois[i];
+        num_pulses[i] -= other.num_pulses[i];
+        height_sum[i] -= other.height_sum[i];
+        integral_sum[i] -= other.integral_sum[i];
+        arrival_sum[i] -= other.arrival_sum[i];
+    }
+    for (size_t i = 0; i < multiplicity.size(); i++) multiplicity[i] -= other.multiplicity[i];
+    for (size_t i = 0; i < coincidences.size(); i++) coincidences[i] -= other.coincidences[i];
+    num_events -= other.num_events;
+}
+
+void LightPulseSummary::AddCoincidence(const ChannelMask &mask) {
+    multiplicity[mask.Count()]++;
+    // Only the few channels that pulsed are visited, not the whole matrix
+    mask.ForEach([&](size_t i) {
+        uint32_t *row = coincidences.data() + i * NUM_LIGHT_CHANNELS;
+        mask.ForEach([&](size_t j) { row[j]++; });
+    });
+}
+
+bool LightPulseFinder::AnalyzeRoi(SampleSpan roi, LightPulse &pulse) {
+    using Math = metric_math::Default;
+    const SampleSpan baseline_words = roi.subspan(0, BASELINE_SAMPLES);
+    if (baseline_words.empty() || roi.size() <= baseline_words.size()) return false;
+    const kernels::SumSquares moments = kernels::SumAndSumSquares(baseline_words);
+    const uint16_t threshold = Math::HitThreshold(moments.sum, moments.sum_sq, baseline_words.size(), PULSE_THRESHOLD_RMS);
+    const auto baseline = static_cast<int32_t>(Math::Mean(moments.sum, baseline_words.size()));
+
+    // One pass for the peak and the integral, the samples are contiguous in the event buffer
+    uint16_t peak = 0;
+    size_t peak_time = 0;
+    int64_t integral = 0;
+    for (size_t s = baseline_words.size(); s < roi.size(); s++) {
+        integral += static_cast<int32_t>(roi[s]) - baseline;
+        if (roi[s] > peak) {
+            peak = roi[s];
+            peak_time = s;
+        }
+    }
+    if (peak <= threshold) return false;
+
+    // Arrival at half height, a short walk back from the peak still in cache
+    const auto height = static_cast<int32_t>(peak) - baseline;
+    const int32_t half_height = baseline + (height + 1) / 2;
+    size_t arrival = peak_time;
+    while (arrival > baseline_words.size() && static_cast<int32_t>(roi[arrival - 1]) >= half_height) arrival--;
+
+    pulse.height = static_cast<uint16_t>(height);
+    pulse.arrival = static_cast<uint16_t>(arrival);
+    pulse.integral = static_cast<uint32_t>(std::clamp<int64_t>(integral, 0, UINT32_MAX));
+    return true;
+}
+
+void LightPulseFinder::FindPulses(const FlatEvent &event, LightPulseList &pulse_list) {
+    pulse_list.Clear();
+    for (size_t i = 0; i < event.NumLightRois(); i++) {
+        uint16_t channel = event.LightChannel(i);
+        if (channel > NUM_LIGHT_CHANNELS-1) continue;
+        LightPulse pulse{};
+        if (!AnalyzeRoi(event.LightSamples(i), pulse)) continue;
+        pulse.channel = channel;
+        pulse.trigger_id = event.LightTriggerId(i);
+        pulse_list.pulses.push_back(pulse);
+        pulse_list.coincidence.Set(channel);
+    }
+}
+
+void LightPulseFinder::SerializePulses(const LightPulseList &pulse_list, const MetricHeader &header, std::vector<uint32_t> &out) {
+    out.clear();
+    out.reserve(4 + 2 * ChannelMask::NUM_WORDS + 2 * pulse_list.pulses.size());
+    out.push_back(header.run_number);
+    out.push_back(header.file_number);
+    out.push_back(header.evt_number);
+    out.push_back(static_cast<uint32_t>(pulse_list.pulses.size()));
+    for (auto word : pulse_list.coincidence.words) {
+        out.push_back(static_cast<uint32_t>(word));
+        out.push_back(static_cast<uint32_t>(word >> 32));
+    }
+    for (const auto &pulse : pulse_list.pulses) {
+        out.push_back(uint32_t{pulse.channel} << 20 | std::min<uint32_t>(pulse.trigger_id, 0xFF) << 12 |
+                      std::min<uint32_t>(pulse.arrival, 0xFFF));
+        out.push_back(std::min<uint32_t>(pulse.height, 0xFFF) << 20 | std::min<uint32_t>(pulse.integral, 0xFFFFF));
+    }
+}
+
+void LightPulseAlg::ProcessEvent(const FlatEvent &event, Partial &partial) const {
+    // Straight into the sums, nothing is kept per ROI
+    ChannelMask coincidence;
+    for (size_t i = 0; i < event.NumLightRois(); i++) {
+        uint16_t channel = event.LightChannel(i);
+        if (channel > NUM_LIGHT_CHANNELS-1) continue;
+        partial.num_rois[channel]++;
+        LightPulse pulse{};
+        if (!LightPulseFinder::AnalyzeRoi(event.LightSamples(i), pulse)) continue;
+        partial.num_pulses[channel]++;
+        partial.height_sum[channel] += pulse.height;
+        partial.integral_sum[channel] += pulse.integral;
+        partial.arrival_sum[channel] += pulse.arrival;
+        coincidence.Set(channel);
+    }
+    partial.AddCoincidence(coincidence);
+    partial.num_events++;
+}
+
+void LightPulseAlg::SerializeMetrics(const Partial &partial, const MetricHeader &header, std::vector<AlgMetric> &out) const {
+    using Math = metric_math::Default;
+    out.push_back({LIGHT_PULSE_SUMMARY_METRIC, {}});
+    std::vector<uint32_t> &payload = out.back().payload;
+    payload.reserve(4 + 5 * NUM_LIGHT_CHANNELS + partial.multiplicity.size() + NUM_LIGHT_CHANNELS * (NUM_LIGHT_CHANNELS + 1) / 2);
+    payload.push_back(header.run_number);
+    payload.push_back(header.file_number);
+    payload.push_back(header.evt_number);
+    payload.push_back(static_cast<uint32_t>(partial.num_events));
+    for (size_t ch = 0; ch < NUM_LIGHT_CHANNELS; ch++) {
+        payload.push_back(static_cast<uint32_t>(partial.num_rois[ch]));
+        payload.push_back(static_cast<uint32_t>(partial.num_pulses[ch]));
+        if (partial.num_pulses[ch] == 0) {
+            payload.insert(payload.end(), 3, 0);
+            continue;
+        }
+        payload.push_back(Math::Mean(partial.height_sum[ch], partial.num_pulses[ch]));
+        payload.push_back(Math::Mean(partial.integral_sum[ch], partial.num_pulses[ch]));
+        payload.push_back(Math::Mean(partial.arrival_sum[ch], partial.num_pulses[ch]));
+    }
+    payload.insert(payload.end(), partial.multiplicity.begin(), partial.multiplicity.end());
+    for (size_t i = 0; i < NUM_LIGHT_CHANNELS; i++) {
+        const uint32_t *row = partial.coincidences.data() + i * NUM_LIGHT_CHANNELS;
+        payload.insert(payload.end(), row + i, row + NUM_LIGHT_CHANNELS);
+    }
+}
@@ -0,0 +1,127 @@
+//
+// Light ROI pulse analysis, pulse height, integral and arrival time plus PMT channel coincidences.
+//
+
+#ifndef LIGHT_PULSES_H
+#define LIGHT_PULSES_H
+
+#include "monitor_algs_base.hpp"
+#include "process_events.h"
+#include "flat_event.h"
+#include "sample_span.h"
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// The pulse in one ROI, height and integral are above the ROI's own baseline
+struct LightPulse {
+    uint16_t channel;
+    uint16_t trigger_id;
+    uint16_t height;
+    uint16_t arrival;     // first sample at half height, from the start of the ROI
+    uint32_t integral;
+};
+
+// One bit per PMT channel
+struct ChannelMask {
+    constexpr static size_t NUM_WORDS = (NUM_LIGHT_CHANNELS + 63) / 64;
+    std::array<uint64_t, NUM_WORDS> words{0};
+
+    void Set(size_t channel) { words[channel / 64] |= uint64_t{1} << (channel % 64); }
+    size_t Count() const;
+    // Calls fn(channel) for every set channel in increasing order
+    template <typename Fn>
+    void ForEach(Fn &&fn) const {
+        for (size_t w = 0; w < NUM_WORDS; w++) {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) fn(w * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+        }
+    }
+};
+
+/*
+ * The pulses of one event, the vector only grows so after the first events it doesn't allocate.
+ */
+struct LightPulseList {
+    std::vector<LightPulse> pulses;
+    ChannelMask coincidence;
+
+    void Clear() { pulses.clear(); coincidence = ChannelMask(); }
+};
+
+/*
+ * Per-channel pulse sums, the distribution of the number of channels with a pulse per event
+ * and how often each pair of channels pulsed in the same event. Integer counts so partials merge
+ * exactly.
+ */
+struct LightPulseSummary {
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> num_rois{0};
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> num_pulses{0};
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> height_sum{0};
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> integral_sum{0};
+    std::array<uint64_t, NUM_LIGHT_CHANNELS> arrival_sum{0};
+    std::array<uint32_t, NUM_LIGHT_CHANNELS + 1> multiplicity{0};
+    // [i * NUM_LIGHT_CHANNELS + j] events with a pulse on both, the diagonal is events with a pulse on i
+    std::array<uint32_t, NUM_LIGHT_CHANNELS * NUM_LIGHT_CHANNELS> coincidences{0};
+    size_t num_events = 0;
+
+    void Merge(const LightPulseSummary &other);
+    void Subtract(const LightPulseSummary &other);
+    void Clear() { *this = LightPulseSummary(); }
+    // Add one event's channel coincidence map
+    void AddCoincidence(const ChannelMask &mask);
+};
+
+class LightPulseFinder {
+public:
+
+    /**
+    *  Measure the largest pulse in an ROI in one pass after the baseline samples.
+    *
+    *   @param [out] pulse:  Filled when there is a pulse, channel and trigger ID are left to the caller
+    *
+    * @return  True if the peak is above BASELINE + PULSE_THRESHOLD_RMS x RMS
+    */
+    static bool AnalyzeRoi(SampleSpan roi, LightPulse &pulse);
+
+    // Every ROI of the event, walked in buffer order, into the list which is cleared first
+    static void FindPulses(const FlatEvent &event, LightPulseList &pulse_list);
+
+    /**
+    *  Per-event pulse metric, all 32b words:
+    *   [0-2]  run, file, event
+    *   [3]    number of pulses
+    *   then the channel coincidence mask, ChannelMask::NUM_WORDS x 2 words, low word first
+    *   then 2 words per pulse:
+    *     channel << 20 | trigger_id << 12 | arrival, arrival saturates at 0xFFF
+    *     height << 20 | integral, height saturates at 0xFFF, integral at 0xFFFFF
+    */
+    static void SerializePulses(const LightPulseList &pulse_list, const MetricHeader &header, std::vector<uint32_t> &out);
+
+    // Leading samples of the ROI used for the baseline & RMS, same as the minimal summary
+    constexpr static size_t BASELINE_SAMPLES = 8;
+    constexpr static uint32_t PULSE_THRESHOLD_RMS = 5;
+};
+
+class LightPulseAlg : public MonitorAlgBase<LightPulseAlg, LightPulseSummary> {
+public:
+    constexpr static uint32_t ALG_ID = 0x10;
+    constexpr static uint32_t LIGHT_PULSE_SUMMARY_METRIC = 0x400D;
+
+    void ProcessEvent(const FlatEvent &event, Partial &partial) const;
+
+    /**
+    *  Payload, all 32b words:
+    *   [0-2]  run, file, event
+    *   [3]    number of events summed
+    *   then per channel: ROIs, pulses, mean height, mean integral, mean arrival
+    *   then the number of events with 0..NUM_LIGHT_CHANNELS channels pulsed
+    *   then the upper triangle of the coincidence counts including the diagonal, row by row
+    */
+    void SerializeMetrics(const Partial &partial, const MetricHeader &header, std::vector<AlgMetric> &out) const;
+};
+
+// Pulses of a single event, sent with the event query waveforms
+constexpr static uint32_t LIGHT_PULSE_METRIC = 0x400E;
+
+#endif //LIGHT_PULSES_H
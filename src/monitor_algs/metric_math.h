@@ -0,0 +1,92 @@
+//
+// Arithmetic policies for finishing the summaries, double precision or integer-only for CPUs with weak FP.
+//
+
+#ifndef METRIC_MATH_H
+#define METRIC_MATH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace metric_math {
+
+    // GCC and Clang both have it, __extension__ keeps -pedantic quiet
+    __extension__ typedef unsigned __int128 Uint128;
+
+    /**
+    *  Largest r with r * r <= x, exact for every 64b input.
+    */
+    inline uint64_t ISqrt(uint64_t x) {
+        // Bit by bit, no FP and a fixed 32 iterations
+        uint64_t result = 0;
+        uint64_t bit = uint64_t{1} << 62;
+        while (bit > x) bit >>= 2;
+        while (bit != 0) {
+            if (x >= result + bit) {
+                x -= result + bit;
+                result = (result >> 1) + bit;
+            } else {
+                result >>= 1;
+            }
+            bit >>= 2;
+        }
+        return result;
+    }
+
+    /*
+     * Both policies take the exact integer sums the summaries keep:
+     *   mean     = sum / count
+     *   variance = var_num / var_norm
+     * and give the same integers the metrics are serialized with. The hit threshold takes one
+     * event's baseline samples, var_num = n sum x^2 - (sum x)^2 and var_norm = n^2.
+     */
+    struct DoubleMath {
+        // floor(mean + n_sigma * rms + 1), samples strictly above it are hits
+        static uint16_t HitThreshold(uint64_t sum, uint64_t sum_sq, uint64_t num_samples, uint32_t n_sigma) {
+            auto n = static_cast<double>(num_samples);
+            double mean = static_cast<double>(sum) / n;
+            double variance = (n * static_cast<double>(sum_sq) - static_cast<double>(sum) * static_cast<double>(sum)) / (n * n);
+            double threshold = mean + n_sigma * std::sqrt(std::max(variance, 0.0)) + 1.0;
+            return static_cast<uint16_t>(std::min(std::floor(threshold), static_cast<double>(UINT16_MAX)));
+        }
+        static uint32_t Mean(uint64_t sum, uint64_t count) {
+            return static_cast<uint32_t>(static_cast<double>(sum) / count);
+        }
+        // scale * RMS truncated, the metrics carry the RMS x15
+        static uint32_t ScaledRms(uint64_t var_num, uint64_t var_norm, uint32_t scale) {
+            return static_cast<uint32_t>(scale * std::sqrt(static_cast<double>(var_num) / var_norm));
+        }
+    };
+
+    struct IntegerMath {
+        static uint16_t HitThreshold(uint64_t sum, uint64_t sum_sq, uint64_t num_samples, uint32_t n_sigma) {
+            // floor((S + k sqrt(V)) / n) + 1 == (S + isqrt(k^2 V)) / n + 1 since S and n are integers.
+            // V is at most n^2 * 65535^2 so k^2 V fits for the baseline sample counts used.
+            const uint64_t var_num = num_samples * sum_sq - sum * sum;
+            const uint64_t threshold = (sum + ISqrt(uint64_t{n_sigma} * n_sigma * var_num)) / num_samples + 1;
+            return static_cast<uint16_t>(std::min<uint64_t>(threshold, UINT16_MAX));
+        }
+        static uint32_t Mean(uint64_t sum, uint64_t count) {
+            return static_cast<uint32_t>(sum / count);
+        }
+        static uint32_t ScaledRms(uint64_t var_num, uint64_t var_norm, uint32_t scale) {
+            // floor(k sqrt(V / N)) == isqrt(floor(k^2 V / N)), k^2 V is formed in 128b so it never overflows.
+            // The quotient is k^2 times a variance of 16b samples, well inside 64b.
+            const Uint128 scaled = Uint128{scale} * scale * var_num / var_norm;
+            return static_cast<uint32_t>(ISqrt(static_cast<uint64_t>(
+                std::min<Uint128>(scaled, std::numeric_limits<uint64_t>::max()))));
+        }
+    };
+
+    // Selected at build time, -DMONITOR_INTEGER_MATH for the integer-only pipeline
+#ifdef MONITOR_INTEGER_MATH
+    using Default = IntegerMath;
+#else
+    using Default = DoubleMath;
+#endif
+
+} // metric_math
+
+#endif //METRIC_MATH_H
@@ -8,38 +8,66 @@
 #include "process_events.h"
 #include "tpc_monitor.h"
 #include "tpc_monitor_lbw.h"
+#include "flat_event.h"
+#include <cstdint>
+#include <vector>
 
+// Identifies the event an algorithm's own metrics belong to
+struct MetricHeader {
+    uint32_t run_number;
+    uint32_t file_number;
+    uint32_t evt_number;
+};
+
+// A serialized metric an algorithm adds on top of the low bandwidth summary
+struct AlgMetric {
+    uint32_t metric_id;
+    std::vector<uint32_t> payload;
+};
+
+/*
+ * Common interface of the monitoring algorithms, resolved at compile time (CRTP) so an
+ * AlgPipeline calls straight into each algorithm with no virtual dispatch per event.
+ *
+ * A derived algorithm provides
+ *   using Partial = ...;                      mergeable per-thread/per-event state
+ *   constexpr static uint32_t ALG_ID;         one bit, used to select algorithms by command
+ *   void ProcessEvent(const FlatEvent &event, Partial &partial) const;
+ * and may hide any of the defaults below.
+ */
+template <typename Derived, typename PartialT>
 class MonitorAlgBase {
 public:
 
-    MonitorAlgBase() = default;
-    virtual ~MonitorAlgBase() = default;
+    using Partial = PartialT;
 
     /**
-    *  Abstract method which will be the common interface to the monitoring algorithm.
-    *
-    *   @param [in] event:  The EvenStruct holding the decoded event data
-    *   @param lbw_metrics
-    *
-    * @return  Returns true on successful configuration, false on failure.
+    *  Fold another partial into this one, must be exact so the order events or
+    *  threads are merged in doesn't change the result.
     */
-    virtual bool ProcessEvent(EventStruct &event) = 0;
+    static void Merge(Partial &partial, const Partial &other) { partial.Merge(other); }
 
     /**
-    *  Abstract method to update metrics to send to ground so they can be accumulated across events.
-    *
-    * @return
+    *  Undo a Merge, e.g. an event leaving a rolling window.
     */
-    virtual bool UpdateMetrics(LowBwTpcMonitor &lbw_metrics, TpcMonitor &metrics) = 0;
+    static void Subtract(Partial &partial, const Partial &other) { partial.Subtract(other); }
+
+    static void Clear(Partial &partial) { partial.Clear(); }
 
     /**
-    *  Abstract method to clear a persistant state, e.g. counters, vectors.
-    *
-    * @return
+    *  Fill this algorithm's part of the low bandwidth summary.
     */
-    virtual void Clear() = 0;
+    void UpdateMetrics(const Partial & /*partial*/, LowBwTpcMonitor & /*lbw_metrics*/, TpcMonitor & /*metrics*/) const {}
 
-private:
+    /**
+    *  Append any metrics of the algorithm's own, sent after the summary.
+    */
+    void SerializeMetrics(const Partial & /*partial*/, const MetricHeader & /*header*/, std::vector<AlgMetric> & /*out*/) const {}
+
+protected:
+
+    MonitorAlgBase() = default;
+    ~MonitorAlgBase() = default;
 
 };
 
@@ -0,0 +1,22 @@
+//
+// The algorithms every query and the live monitor run, add new algorithms here.
+//
+
+#ifndef MONITOR_PIPELINE_H
+#define MONITOR_PIPELINE_H
+
+#include "alg_pipeline.h"
+#include "charge_algs.h"
+#include "light_algs.h"
+#include "adc_histogram.h"
+#include "hit_finder.h"
+#include "light_pulses.h"
+
+/*
+ * A new algorithm only needs its own Partial, a unique ALG_ID bit and to be listed here.
+ * Queries select a subset with the OR of their ALG_IDs, see MonitorQuery.
+ */
+using MinimalPipeline = AlgPipeline<ChargeSummaryAlg, LightSummaryAlg, AdcHistogramAlg, HitFinderAlg,
+                                    LightPulseAlg>;
+
+#endif //MONITOR_PIPELINE_H
@@ -0,0 +1,140 @@
+//
+// Streaming per-channel baseline & RMS, a sliding window of exact sums and a fixed-point EWMA.
+//
+
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+#include "simd_kernels.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Both estimates are built from each event's own baseline moments, the sample mean and the
+ * variance about it, (n sum x^2 - (sum x)^2) / n^2, which is exact in integers. Nothing is
+ * measured against a mean that is still moving so they are correct from the first event.
+ *
+ *  - Window: exact integer sums over the last N events, the oldest event is subtracted as a new
+ *    one arrives so no precision is lost however long it runs. The samples of the window's events
+ *    are pooled, where the summaries average the per-event values.
+ *  - EWMA: mean and variance in Q16 fixed point, each event moves them by 2^-shift of the
+ *    difference. The first event initializes them.
+ */
+template <size_t NumChannels>
+class RunningStats {
+public:
+    /**
+    *  @param [in] window_events:  Events in the sliding window, at least 1
+    *  @param [in] ewma_shift:  EWMA weight of a new event is 2^-shift, e.g. 4 -> 1/16
+    */
+    explicit RunningStats(size_t window_events = 64, uint8_t ewma_shift = 4) :
+        window_size_(window_events < 1 ? 1 : window_events), window_(window_size_ + 1), ewma_shift_(ewma_shift) {}
+
+    /**
+    *  Add one channel's baseline moments for the current event.
+    *   @param [in] num_samples:  Number of baseline samples the moments are over
+    */
+    void Add(size_t channel, uint64_t num_samples, const kernels::SumSquares &moments) {
+        if (channel >= NumChannels || num_samples == 0) return;
+        const uint64_t var_num = num_samples * moments.sum_sq - moments.sum * moments.sum;
+        const uint64_t var_norm = num_samples * num_samples;
+
+        Moments &slot = window_[head_][channel];
+        slot.sum += moments.sum;
+        slot.num_samples += num_samples;
+        slot.var_num += var_num;
+        slot.var_norm += var_norm;
+        window_sum_[channel].sum += moments.sum;
+        window_sum_[channel].num_samples += num_samples;
+        window_sum_[channel].var_num += var_num;
+        window_sum_[channel].var_norm += var_norm;
+
+        const auto mean_q = static_cast<int64_t>((moments.sum << FRAC_BITS) / num_samples);
+        const auto var_q = static_cast<int64_t>((var_num << FRAC_BITS) / var_norm);
+        Ewma &ewma = ewma_[channel];
+        if (ewma.num_events == 0) {
+            ewma.mean_q = mean_q;
+            ewma.var_q = var_q;
+        } else {
+            ewma.mean_q += (mean_q - ewma.mean_q) / (int64_t{1} << ewma_shift_);
+            ewma.var_q += (var_q - ewma.var_q) / (int64_t{1} << ewma_shift_);
+        }
+        ewma.num_events++;
+    }
+
+    // Close the current event, once the window is full the oldest event leaves it
+    void EndEvent() {
+        head_ = (head_ + 1) % window_.size();
+        if (num_events_ < window_size_) {
+            num_events_++;
+        } else {
+            for (size_t ch = 0; ch < NumChannels; ch++) {
+                Moments &oldest = window_[head_][ch];
+                window_sum_[ch].sum -= oldest.sum;
+                window_sum_[ch].num_samples -= oldest.num_samples;
+                window_sum_[ch].var_num -= oldest.var_num;
+                window_sum_[ch].var_norm -= oldest.var_norm;
+                oldest = Moments();
+            }
+        }
+    }
+
+    double WindowMean(size_t channel) const {
+        const Moments &m = window_sum_.at(channel);
+        return m.num_samples == 0 ? 0.0 : static_cast<double>(m.sum) / static_cast<double>(m.num_samples);
+    }
+    double WindowRms(size_t channel) const {
+        const Moments &m = window_sum_.at(channel);
+        return m.var_norm == 0 ? 0.0 : std::sqrt(static_cast<double>(m.var_num) / static_cast<double>(m.var_norm));
+    }
+    double EwmaMean(size_t channel) const { return static_cast<double>(ewma_.at(channel).mean_q) / ONE_Q; }
+    double EwmaRms(size_t channel) const { return std::sqrt(static_cast<double>(ewma_.at(channel).var_q) / ONE_Q); }
+    // Raw Q16 values for sending without going through floating point
+    int64_t EwmaMeanQ16(size_t channel) const { return ewma_.at(channel).mean_q; }
+    int64_t EwmaVarianceQ16(size_t channel) const { return ewma_.at(channel).var_q; }
+
+    bool HasData(size_t channel) const { return ewma_.at(channel).num_events > 0; }
+    size_t WindowEvents() const { return num_events_; }
+
+    void Clear() {
+        for (auto &slot : window_) slot.fill(Moments());
+        window_sum_.fill(Moments());
+        ewma_.fill(Ewma());
+        head_ = 0;
+        num_events_ = 0;
+    }
+
+    constexpr static int FRAC_BITS = 16;
+
+private:
+
+    struct Moments {
+        uint64_t sum = 0;
+        uint64_t num_samples = 0;
+        uint64_t var_num = 0;
+        uint64_t var_norm = 0;
+    };
+
+    struct Ewma {
+        int64_t mean_q = 0;
+        int64_t var_q = 0;
+        size_t num_events = 0;
+    };
+
+    constexpr static double ONE_Q = static_cast<double>(int64_t{1} << FRAC_BITS);
+
+    // One slot per event plus the one being filled at head_
+    size_t window_size_;
+    std::vector<std::array<Moments, NumChannels>> window_;
+    std::array<Moments, NumChannels> window_sum_{};
+    std::array<Ewma, NumChannels> ewma_{};
+    size_t head_ = 0;
+    size_t num_events_ = 0;
+    uint8_t ewma_shift_;
+
+};
+
+#endif //RUNNING_STATS_H
@@ -0,0 +1,42 @@
+//
+// Non-owning views onto ADC samples in decoded or flat event buffers, and onto event words in a mapped file.
+//
+
+#ifndef SAMPLE_SPAN_H
+#define SAMPLE_SPAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Minimal read-only span since we are on C++17 and don't have std::span
+template <typename T>
+class ConstSpan {
+public:
+    constexpr ConstSpan() = default;
+    constexpr ConstSpan(const T *data, size_t size) : data_(data), size_(size) {}
+    ConstSpan(const std::vector<T> &vec) : data_(vec.data()), size_(vec.size()) {}
+
+    constexpr const T* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
+    constexpr bool empty() const { return size_ == 0; }
+    constexpr const T* begin() const { return data_; }
+    constexpr const T* end() const { return data_ + size_; }
+    constexpr const T& operator[](size_t i) const { return data_[i]; }
+
+    // Clamped to the span so asking past the end gives a shorter (or empty) view
+    constexpr ConstSpan subspan(size_t offset, size_t count) const {
+        if (offset > size_) offset = size_;
+        if (count > size_ - offset) count = size_ - offset;
+        return {data_ + offset, count};
+    }
+
+private:
+    const T *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+using SampleSpan = ConstSpan<uint16_t>;
+using WordSpan = ConstSpan<uint32_t>;
+
+#endif //SAMPLE_SPAN_H
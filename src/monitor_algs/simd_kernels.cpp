@@ -0,0 +1,282 @@
+//
+// Vectorized sample kernels with a runtime selected ISA and a scalar fallback.
+//
+
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_KERNELS_X86 1
+#endif
+
+namespace kernels {
+
+namespace {
+
+    SumSquares SumSquaresScalar(const uint16_t *samples, size_t num_samples) {
+        SumSquares result{0, 0};
+        for (size_t i = 0; i < num_samples; i++) {
+            uint64_t s = samples[i];
+            result.sum += s;
+            result.sum_sq += s * s;
+        }
+        return result;
+    }
+
+    size_t CountAboveScalar(const uint16_t *samples, size_t num_samples, uint16_t threshold) {
+        size_t count = 0;
+        for (size_t i = 0; i < num_samples; i++) count += samples[i] > threshold;
+        return count;
+    }
+
+    // Bins of 4 consecutive samples go to 4 tables, the output and 3 private ones folded in at the end
+    constexpr static size_t NUM_SUB_HISTOGRAMS = 4;
+
+    inline size_t BinOf(uint16_t sample, uint8_t bin_shift, size_t last_bin) {
+        size_t bin = sample >> bin_shift;
+        return bin < last_bin ? bin : last_bin;
+    }
+
+    void HistogramScalar(const uint16_t *samples, size_t num_samples, uint8_t bin_shift, uint32_t *bins, size_t num_bins) {
+        if (num_bins == 0) return;
+        const size_t last_bin = num_bins - 1;
+        size_t i = 0;
+        if (num_bins <= MAX_FAST_HISTOGRAM_BINS) {
+            uint32_t sub[NUM_SUB_HISTOGRAMS - 1][MAX_FAST_HISTOGRAM_BINS];
+            for (auto &table : sub) std::fill(table, table + num_bins, 0);
+            for (; i + NUM_SUB_HISTOGRAMS <= num_samples; i += NUM_SUB_HISTOGRAMS) {
+                bins[BinOf(samples[i], bin_shift, last_bin)]++;
+                sub[0][BinOf(samples[i + 1], bin_shift, last_bin)]++;
+                sub[1][BinOf(samples[i + 2], bin_shift, last_bin)]++;
+                sub[2][BinOf(samples[i + 3], bin_shift, last_bin)]++;
+            }
+            for (size_t b = 0; b < num_bins; b++) bins[b] += sub[0][b] + sub[1][b] + sub[2][b];
+        }
+        for (; i < num_samples; i++) bins[BinOf(samples[i], bin_shift, last_bin)]++;
+    }
+
+    // Open and close regions at the set bits of edges, bit j is a change between samples base + j - 1 and base + j
+    inline void AddEdges(uint32_t edges, size_t base, bool &in_region, size_t &num_regions, Region *regions, size_t max_regions) {
+        for (; edges != 0; edges &= edges - 1) {
+            const auto at = static_cast<uint32_t>(base + static_cast<size_t>(__builtin_ctz(edges)));
+            if (!in_region) {
+                if (num_regions < max_regions) regions[num_regions].begin = at;
+            } else {
+                if (num_regions < max_regions) regions[num_regions].end = at;
+                num_regions++;
+            }
+            in_region = !in_region;
+        }
+    }
+
+    // Closes a region still open at the end of the samples
+    inline size_t CloseRegions(size_t num_samples, bool in_region, size_t num_regions, Region *regions, size_t max_regions) {
+        if (!in_region) return num_regions;
+        if (num_regions < max_regions) regions[num_regions].end = static_cast<uint32_t>(num_samples);
+        return num_regions + 1;
+    }
+
+    size_t FindRegionsScalar(const uint16_t *samples, size_t num_samples, uint16_t threshold, Region *regions, size_t max_regions) {
+        bool in_region = false;
+        size_t num_regions = 0;
+        for (size_t i = 0; i < num_samples; i++) {
+            if ((samples[i] > threshold) != in_region) AddEdges(1, i, in_region, num_regions, regions, max_regions);
+        }
+        return CloseRegions(num_samples, in_region, num_regions, regions, max_regions);
+    }
+
+#ifdef SIMD_KERNELS_X86
+
+    // 16b lane counters are flushed to the 64b total before they can overflow
+    constexpr static size_t COUNT_FLUSH_BLOCKS = 4096;
+
+    __attribute__((target("sse4.1")))
+    SumSquares SumSquaresSse41(const uint16_t *samples, size_t num_samples) {
+        __m128i sum = _mm_setzero_si128();
+        __m128i sum_sq = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 8 <= num_samples; i += 8) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            // Widen to 32b so the squares of any uint16_t fit, then to 64b to accumulate
+            __m128i lo = _mm_cvtepu16_epi32(x);
+            __m128i hi = _mm_cvtepu16_epi32(_mm_srli_si128(x, 8));
+            __m128i sq_lo = _mm_mullo_epi32(lo, lo);
+            __m128i sq_hi = _mm_mullo_epi32(hi, hi);
+            sum = _mm_add_epi64(sum, _mm_cvtepu32_epi64(_mm_add_epi32(lo, hi)));
+            sum = _mm_add_epi64(sum, _mm_cvtepu32_epi64(_mm_srli_si128(_mm_add_epi32(lo, hi), 8)));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_cvtepu32_epi64(sq_lo));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_cvtepu32_epi64(_mm_srli_si128(sq_lo, 8)));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_cvtepu32_epi64(sq_hi));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_cvtepu32_epi64(_mm_srli_si128(sq_hi, 8)));
+        }
+        alignas(16) uint64_t lanes[2];
+        SumSquares result = SumSquaresScalar(samples + i, num_samples - i);
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum);
+        result.sum += lanes[0] + lanes[1];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum_sq);
+        result.sum_sq += lanes[0] + lanes[1];
+        return result;
+    }
+
+    __attribute__((target("sse4.1")))
+    size_t CountAboveSse41(const uint16_t *samples, size_t num_samples, uint16_t threshold) {
+        if (threshold == UINT16_MAX) return 0;
+        // x > t  <=>  max(x, t + 1) == x, SSE has no unsigned 16b greater-than
+        const __m128i t1 = _mm_set1_epi16(static_cast<int16_t>(threshold + 1));
+        size_t count = 0;
+        size_t i = 0;
+        while (i + 8 <= num_samples) {
+            __m128i counts = _mm_setzero_si128();
+            for (size_t block = 0; block < COUNT_FLUSH_BLOCKS && i + 8 <= num_samples; block++, i += 8) {
+                __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+                __m128i above = _mm_cmpeq_epi16(_mm_max_epu16(x, t1), x);
+                counts = _mm_sub_epi16(counts, above); // lanes are -1 where above
+            }
+            __m128i pairs = _mm_madd_epi16(counts, _mm_set1_epi16(1));
+            alignas(16) int32_t lanes[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), pairs);
+            count += static_cast<size_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+        return count + CountAboveScalar(samples + i, num_samples - i, threshold);
+    }
+
+    __attribute__((target("avx2")))
+    SumSquares SumSquaresAvx2(const uint16_t *samples, size_t num_samples) {
+        __m256i sum = _mm256_setzero_si256();
+        __m256i sum_sq = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= num_samples; i += 8) {
+            __m256i x = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)));
+            __m256i sq = _mm256_mullo_epi32(x, x);
+            sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(x)));
+            sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(x, 1)));
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sq)));
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sq, 1)));
+        }
+        alignas(32) uint64_t lanes[4];
+        SumSquares result = SumSquaresScalar(samples + i, num_samples - i);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        result.sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum_sq);
+        result.sum_sq += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        return result;
+    }
+
+    __attribute__((target("avx2")))
+    size_t CountAboveAvx2(const uint16_t *samples, size_t num_samples, uint16_t threshold) {
+        if (threshold == UINT16_MAX) return 0;
+        const __m256i t1 = _mm256_set1_epi16(static_cast<int16_t>(threshold + 1));
+        size_t count = 0;
+        size_t i = 0;
+        while (i + 16 <= num_samples) {
+            __m256i counts = _mm256_setzero_si256();
+            for (size_t block = 0; block < COUNT_FLUSH_BLOCKS && i + 16 <= num_samples; block++, i += 16) {
+                __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+                __m256i above = _mm256_cmpeq_epi16(_mm256_max_epu16(x, t1), x);
+                counts = _mm256_sub_epi16(counts, above);
+            }
+            __m256i pairs = _mm256_madd_epi16(counts, _mm256_set1_epi16(1));
+            alignas(32) int32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), pairs);
+            for (auto lane : lanes) count += static_cast<size_t>(lane);
+        }
+        return count + CountAboveScalar(samples + i, num_samples - i, threshold);
+    }
+
+    __attribute__((target("avx2")))
+    void HistogramAvx2(const uint16_t *samples, size_t num_samples, uint8_t bin_shift, uint32_t *bins, size_t num_bins) {
+        if (num_bins == 0) return;
+        if (num_bins > MAX_FAST_HISTOGRAM_BINS || num_bins > UINT16_MAX) {
+            HistogramScalar(samples, num_samples, bin_shift, bins, num_bins);
+            return;
+        }
+        uint32_t sub[NUM_SUB_HISTOGRAMS - 1][MAX_FAST_HISTOGRAM_BINS];
+        for (auto &table : sub) std::fill(table, table + num_bins, 0);
+        uint32_t *tables[NUM_SUB_HISTOGRAMS] = {bins, sub[0], sub[1], sub[2]};
+
+        const __m128i shift = _mm_cvtsi32_si128(bin_shift);
+        const __m256i last_bin = _mm256_set1_epi16(static_cast<int16_t>(num_bins - 1));
+        alignas(32) uint16_t index[16];
+        size_t i = 0;
+        for (; i + 16 <= num_samples; i += 16) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+            __m256i bin = _mm256_min_epu16(_mm256_srl_epi16(x, shift), last_bin);
+            // A baseline sits in one bin, or two when it is near a bin edge, so most blocks
+            // are added with two counts instead of 16 increments
+            __m128i half_min = _mm_min_epu16(_mm256_castsi256_si128(bin), _mm256_extracti128_si256(bin, 1));
+            __m128i half_max = _mm_max_epu16(_mm256_castsi256_si128(bin), _mm256_extracti128_si256(bin, 1));
+            const auto low_bin = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_minpos_epu16(half_min)));
+            const auto high_bin = static_cast<uint16_t>(UINT16_MAX - _mm_cvtsi128_si32(
+                _mm_minpos_epu16(_mm_xor_si128(half_max, _mm_set1_epi16(-1)))));
+            if (high_bin - low_bin <= 1) {
+                __m256i low = _mm256_set1_epi16(static_cast<int16_t>(low_bin));
+                const auto num_low = static_cast<uint32_t>(__builtin_popcount(
+                    static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(bin, low))))) / 2;
+                bins[low_bin] += num_low;
+                if (num_low < 16) bins[high_bin] += 16 - num_low;
+                continue;
+            }
+            _mm256_store_si256(reinterpret_cast<__m256i*>(index), bin);
+            for (size_t j = 0; j < 16; j++) tables[j % NUM_SUB_HISTOGRAMS][index[j]]++;
+        }
+        for (size_t b = 0; b < num_bins; b++) bins[b] += sub[0][b] + sub[1][b] + sub[2][b];
+        for (; i < num_samples; i++) bins[BinOf(samples[i], bin_shift, num_bins - 1)]++;
+    }
+
+    __attribute__((target("avx2")))
+    size_t FindRegionsAvx2(const uint16_t *samples, size_t num_samples, uint16_t threshold, Region *regions, size_t max_regions) {
+        if (threshold == UINT16_MAX) return 0;
+        const __m256i t1 = _mm256_set1_epi16(static_cast<int16_t>(threshold + 1));
+        bool in_region = false;
+        size_t num_regions = 0;
+        size_t i = 0;
+        for (; i + 16 <= num_samples; i += 16) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+            __m256i above = _mm256_cmpeq_epi16(_mm256_max_epu16(x, t1), x);
+            // One bit per sample, packs works per 128b lane so samples 8-15 land in bits 16-23
+            const auto bytes = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_packs_epi16(above, _mm256_setzero_si256())));
+            const uint32_t mask = (bytes & 0xFF) | ((bytes >> 8) & 0xFF00);
+            // Nothing changes inside the block, the usual case
+            if (mask == (in_region ? 0xFFFFu : 0u)) continue;
+            const uint32_t previous = (mask << 1 | static_cast<uint32_t>(in_region)) & 0xFFFF;
+            AddEdges(mask ^ previous, i, in_region, num_regions, regions, max_regions);
+        }
+        for (; i < num_samples; i++) {
+            if ((samples[i] > threshold) != in_region) AddEdges(1, i, in_region, num_regions, regions, max_regions);
+        }
+        return CloseRegions(num_samples, in_region, num_regions, regions, max_regions);
+    }
+
+#endif // SIMD_KERNELS_X86
+
+    const KernelSet SCALAR_KERNELS{"scalar", SumSquaresScalar, CountAboveScalar, HistogramScalar, FindRegionsScalar};
+
+    KernelSet SelectKernels() {
+#ifdef SIMD_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return {"avx2", SumSquaresAvx2, CountAboveAvx2, HistogramAvx2, FindRegionsAvx2};
+        if (__builtin_cpu_supports("sse4.1")) return {"sse4.1", SumSquaresSse41, CountAboveSse41, HistogramScalar, FindRegionsScalar};
+#endif
+        return SCALAR_KERNELS;
+    }
+
+} // namespace
+
+    const KernelSet& ActiveKernels() {
+        static const KernelSet active = SelectKernels();
+        return active;
+    }
+
+    const KernelSet& ScalarKernels() {
+        return SCALAR_KERNELS;
+    }
+
+    size_t CountAbove(SampleSpan samples, double threshold) {
+        if (threshold < 0) return samples.size();
+        if (threshold >= UINT16_MAX) return 0;
+        return CountAbove(samples, static_cast<uint16_t>(std::floor(threshold)));
+    }
+
+} // kernels
@@ -0,0 +1,87 @@
+//
+// Vectorized sample kernels with a runtime selected ISA and a scalar fallback.
+//
+
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include "sample_span.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace kernels {
+
+    struct SumSquares {
+        uint64_t sum;
+        uint64_t sum_sq;
+    };
+
+    // Samples [begin, end) of a contiguous run above threshold
+    struct Region {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // One implementation of every kernel for a given instruction set
+    struct KernelSet {
+        const char *isa;
+        SumSquares (*sum_squares)(const uint16_t *samples, size_t num_samples);
+        size_t (*count_above)(const uint16_t *samples, size_t num_samples, uint16_t threshold);
+        void (*histogram)(const uint16_t *samples, size_t num_samples, uint8_t bin_shift, uint32_t *bins, size_t num_bins);
+        size_t (*find_regions)(const uint16_t *samples, size_t num_samples, uint16_t threshold, Region *regions, size_t max_regions);
+    };
+
+    // Larger histograms are still filled, just without the private sub-histograms
+    constexpr static size_t MAX_FAST_HISTOGRAM_BINS = 512;
+
+    // Picked once on first use from what the CPU supports, AVX2 > SSE4.1 > scalar
+    const KernelSet& ActiveKernels();
+    const KernelSet& ScalarKernels();
+
+    /**
+    *  Integer sum and sum of squares of the samples, exact for any uint16_t input.
+    */
+    inline SumSquares SumAndSumSquares(SampleSpan samples) {
+        return ActiveKernels().sum_squares(samples.data(), samples.size());
+    }
+
+    /**
+    *  Number of samples strictly greater than the threshold.
+    */
+    inline size_t CountAbove(SampleSpan samples, uint16_t threshold) {
+        return ActiveKernels().count_above(samples.data(), samples.size(), threshold);
+    }
+
+    /**
+    *  Number of samples strictly greater than a floating point threshold. Since the samples
+    *  are integers, x > t is the same as x > floor(t), so this is exact.
+    */
+    size_t CountAbove(SampleSpan samples, double threshold);
+
+    /**
+    *  Add the samples to a histogram of bins 2^bin_shift ADC counts wide, samples past the
+    *  last bin go in the last bin. Runs of the same bin, e.g. a quiet baseline, are added at
+    *  once and the rest are spread over private sub-histograms so repeated increments of one
+    *  bin don't wait on each other.
+    *
+    *   @param [in,out] bins:  Counts, added to and not cleared
+    */
+    inline void Histogram(SampleSpan samples, uint8_t bin_shift, uint32_t *bins, size_t num_bins) {
+        ActiveKernels().histogram(samples.data(), samples.size(), bin_shift, bins, num_bins);
+    }
+
+    /**
+    *  Find the runs of samples strictly greater than the threshold. Blocks entirely above or
+    *  below it, nearly all of a waveform, cost one compare.
+    *
+    *   @param [out] regions:  The first max_regions runs, in order
+    *
+    * @return  Number of runs found, may be more than max_regions
+    */
+    inline size_t FindRegions(SampleSpan samples, uint16_t threshold, Region *regions, size_t max_regions) {
+        return ActiveKernels().find_regions(samples.data(), samples.size(), threshold, regions, max_regions);
+    }
+
+} // kernels
+
+#endif //SIMD_KERNELS_H
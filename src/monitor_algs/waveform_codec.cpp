@@ -0,0 +1,131 @@
+//
+// Compressed waveform payload, baseline subtracted deltas bit-packed in fixed size blocks.
+//
+
+#include "waveform_codec.h"
+#include <algorithm>
+
+namespace waveform_codec {
+
+namespace {
+
+    constexpr static size_t HEADER_WORDS = 2;
+    constexpr static size_t WIDTHS_PER_WORD = 4;
+
+    inline uint32_t ZigZag(int32_t delta) {
+        return (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+    }
+
+    inline int32_t UnZigZag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    inline uint32_t BitWidth(uint32_t value) {
+        return value == 0 ? 0 : 32 - static_cast<uint32_t>(__builtin_clz(value));
+    }
+
+    // Appends bits LSB first into 32b words
+    class BitWriter {
+    public:
+        explicit BitWriter(std::vector<uint32_t> &out) : out_(out) {}
+        void Write(uint32_t value, uint32_t num_bits) {
+            if (num_bits == 0) return;
+            acc_ |= static_cast<uint64_t>(value) << fill_;
+            fill_ += num_bits;
+            if (fill_ >= 32) {
+                out_.push_back(static_cast<uint32_t>(acc_));
+                acc_ >>= 32;
+                fill_ -= 32;
+            }
+        }
+        void Flush() {
+            if (fill_ > 0) out_.push_back(static_cast<uint32_t>(acc_));
+            acc_ = 0;
+            fill_ = 0;
+        }
+    private:
+        std::vector<uint32_t> &out_;
+        uint64_t acc_ = 0;
+        uint32_t fill_ = 0;
+    };
+
+    template <typename T>
+    void EncodeSamples(ConstSpan<T> samples, uint16_t baseline, std::vector<uint32_t> &out) {
+        const size_t num_samples = std::min(samples.size(), MAX_SAMPLES);
+        const size_t num_blocks = (num_samples + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+        out.push_back((CODEC_TAG << 24) | (CODEC_VERSION << 16) | static_cast<uint32_t>(num_samples));
+        out.push_back(baseline);
+
+        // Reserve the block width words, filled in as each block is sized
+        const size_t widths_pos = out.size();
+        out.resize(out.size() + (num_blocks + WIDTHS_PER_WORD - 1) / WIDTHS_PER_WORD, 0);
+
+        BitWriter writer(out);
+        uint32_t zigzag[BLOCK_SAMPLES];
+        int32_t previous = baseline;
+        for (size_t block = 0; block < num_blocks; block++) {
+            const size_t start = block * BLOCK_SAMPLES;
+            const size_t len = std::min(BLOCK_SAMPLES, num_samples - start);
+            uint32_t all_bits = 0;
+            for (size_t i = 0; i < len; i++) {
+                auto sample = static_cast<int32_t>(static_cast<uint16_t>(samples[start + i]));
+                zigzag[i] = ZigZag(sample - previous);
+                all_bits |= zigzag[i];
+                previous = sample;
+            }
+            const uint32_t width = BitWidth(all_bits);
+            out[widths_pos + block / WIDTHS_PER_WORD] |= width << (8 * (block % WIDTHS_PER_WORD));
+            for (size_t i = 0; i < len; i++) writer.Write(zigzag[i], width);
+        }
+        writer.Flush();
+    }
+
+} // namespace
+
+    void Encode(ConstSpan<uint16_t> samples, uint16_t baseline, std::vector<uint32_t> &out) {
+        EncodeSamples(samples, baseline, out);
+    }
+
+    void Encode(ConstSpan<uint32_t> samples, uint16_t baseline, std::vector<uint32_t> &out) {
+        EncodeSamples(samples, baseline, out);
+    }
+
+    size_t Decode(ConstSpan<uint32_t> words, std::vector<uint16_t> &samples) {
+        samples.clear();
+        if (words.size() < HEADER_WORDS) return 0;
+        if ((words[0] >> 24) != CODEC_TAG || ((words[0] >> 16) & 0xFF) != CODEC_VERSION) return 0;
+        const size_t num_samples = words[0] & 0xFFFF;
+        const auto baseline = static_cast<int32_t>(words[1] & 0xFFFF);
+        const size_t num_blocks = (num_samples + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+        const size_t widths_pos = HEADER_WORDS;
+        size_t pos = widths_pos + (num_blocks + WIDTHS_PER_WORD - 1) / WIDTHS_PER_WORD;
+        if (pos > words.size()) return 0;
+
+        uint64_t acc = 0;
+        uint32_t fill = 0;
+        int32_t previous = baseline;
+        samples.reserve(num_samples);
+        for (size_t block = 0; block < num_blocks; block++) {
+            const uint32_t width = (words[widths_pos + block / WIDTHS_PER_WORD] >> (8 * (block % WIDTHS_PER_WORD))) & 0xFF;
+            if (width > 32) return 0;
+            const size_t len = std::min(BLOCK_SAMPLES, num_samples - block * BLOCK_SAMPLES);
+            for (size_t i = 0; i < len; i++) {
+                uint32_t value = 0;
+                if (width > 0) {
+                    if (fill < width) {
+                        if (pos >= words.size()) return 0;
+                        acc |= static_cast<uint64_t>(words[pos++]) << fill;
+                        fill += 32;
+                    }
+                    value = static_cast<uint32_t>(acc & ((uint64_t{1} << width) - 1));
+                    acc >>= width;
+                    fill -= width;
+                }
+                previous += UnZigZag(value);
+                samples.push_back(static_cast<uint16_t>(previous));
+            }
+        }
+        return pos;
+    }
+
+} // waveform_codec
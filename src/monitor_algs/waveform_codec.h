@@ -0,0 +1,48 @@
+//
+// Compressed waveform payload, baseline subtracted deltas bit-packed in fixed size blocks.
+//
+
+#ifndef WAVEFORM_CODEC_H
+#define WAVEFORM_CODEC_H
+
+#include "sample_span.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace waveform_codec {
+
+    /*
+     * Payload layout, all 32b words:
+     *   [0]  CODEC_TAG << 24 | CODEC_VERSION << 16 | number of samples
+     *   [1]  baseline
+     *   then one 8b bit width per block of BLOCK_SAMPLES, packed 4 per word
+     *   then the zigzag encoded deltas of each block at its bit width, packed LSB first.
+     * The first delta is relative to the baseline, the rest to the previous sample, so a quiet
+     * channel packs down to a few bits per sample.
+     */
+    constexpr static uint32_t CODEC_TAG = 0xC5;
+    constexpr static uint32_t CODEC_VERSION = 1;
+    constexpr static size_t BLOCK_SAMPLES = 32;
+    constexpr static size_t MAX_SAMPLES = 0xFFFF;
+
+    /**
+    *  Append the encoded samples to the output, the output buffer can be reused between calls.
+    *  Samples are treated as 16b, more than MAX_SAMPLES are truncated.
+    */
+    void Encode(ConstSpan<uint16_t> samples, uint16_t baseline, std::vector<uint32_t> &out);
+    void Encode(ConstSpan<uint32_t> samples, uint16_t baseline, std::vector<uint32_t> &out);
+
+    /**
+    *  Reference decoder for the ground side.
+    *
+    *   @param [in] words:  Encoded payload starting at the tag word
+    *   @param [out] samples:  Decoded samples
+    *
+    * @return  Number of words consumed, 0 if the payload is malformed.
+    */
+    size_t Decode(ConstSpan<uint32_t> words, std::vector<uint16_t> &samples);
+
+} // waveform_codec
+
+#endif //WAVEFORM_CODEC_H